@@ -0,0 +1,96 @@
+#!/usr/bin/env node
+
+// Compares two builds of the plugin: times each over a set of inputs and
+// reports the mean wall-clock time per run, the output size and whether
+// both builds wrote the same output.
+//
+//   ./bench.js <iterations> <baseline plugin> <plugin> [plugin args...]
+//
+// The baseline is typically libClengPlugin.so built from the commit before
+// the change being measured.  The output is read from where the plugin args
+// say it is written (output=, binary, cbor and compress= are honoured);
+// output-dir= names the file after a hash of the input and is not supported.
+
+var child_process = require('child_process');
+var fs = require('fs');
+
+var corpus = [
+  ['gl3.h', '-x', 'c++'],
+  ['namespaces.cpp']
+];
+
+if (process.argv.length < 5) {
+  console.error('usage: bench.js <iterations> <baseline plugin> <plugin> [plugin args...]');
+  process.exit(2);
+}
+
+var iterations = parseInt(process.argv[2], 10);
+var plugins = { baseline: process.argv[3], change: process.argv[4] };
+var pluginArgs = process.argv.slice(5);
+
+// Mirrors outputPath() in src/plugin.cpp.
+function outputPath() {
+  var extension = '.json';
+  var suffix = '';
+  var output = null;
+
+  pluginArgs.forEach(function(arg) {
+    var separator = arg.indexOf('=');
+    var name = separator < 0 ? arg : arg.slice(0, separator);
+    var value = separator < 0 ? '' : arg.slice(separator + 1);
+
+    if (name === 'binary')
+      extension = '.bin';
+    else if (name === 'cbor')
+      extension = '.cbor';
+    else if (name === 'compress')
+      suffix = { gzip: '.gz', zstd: '.zst' }[value.split(':')[0]] || '';
+    else if (name === 'output')
+      output = value;
+    else if (name === 'output-dir') {
+      console.error('bench.js: output-dir is not supported, use output=<path>');
+      process.exit(2);
+    }
+  });
+
+  return output !== null ? output : 'output' + extension + suffix;
+}
+
+function command(plugin, input) {
+  var args = input.slice(1).concat([input[0], '-fsyntax-only', '-Xclang', '-load', '-Xclang', plugin, '-Xclang', '-plugin', '-Xclang', 'cleng']);
+  pluginArgs.forEach(function(arg) {
+    args.push('-Xclang', '-plugin-arg-cleng', '-Xclang', arg);
+  });
+  return args;
+}
+
+// Returns the mean time per run in ms and the output of the last run.
+function measure(plugin, input) {
+  var args = command(plugin, input);
+  var path = outputPath();
+  var total = 0;
+
+  for (var i = 0; i < iterations; ++i) {
+    var start = process.hrtime();
+    var result = child_process.spawnSync('clang++', args, { stdio: 'inherit' });
+    var elapsed = process.hrtime(start);
+    if (result.status !== 0) {
+      console.error(input[0] + ': clang++ exited with status ' + result.status + ' using ' + plugin);
+      process.exit(1);
+    }
+    total += elapsed[0] * 1e3 + elapsed[1] / 1e6;
+  }
+
+  return { time: total / iterations, output: fs.readFileSync(path) };
+}
+
+corpus.forEach(function(input) {
+  var baseline = measure(plugins.baseline, input);
+  var change = measure(plugins.change, input);
+
+  console.log(input[0] + ':');
+  console.log('  baseline: ' + baseline.time.toFixed(1) + ' ms/run, ' + baseline.output.length + ' bytes');
+  console.log('  change:   ' + change.time.toFixed(1) + ' ms/run, ' + change.output.length + ' bytes');
+  console.log('  speedup:  ' + (baseline.time / change.time).toFixed(2) + 'x, output ' +
+              (baseline.output.equals(change.output) ? 'identical' : 'differs'));
+});
@@ -0,0 +1,55 @@
+// Namespace-heavy corpus used by bench.js: every class below sits several
+// DeclContexts deep, so each method and parameter is nested inside
+// namespace -> namespace -> class -> method -> params.
+
+#define DECLARE_SHAPE(name)                                              \
+  class name {                                                           \
+  public:                                                                \
+    name();                                                              \
+    name(const name& other);                                             \
+    explicit name(double scale, int sides = 4);                          \
+    virtual ~name();                                                     \
+                                                                         \
+    name& operator=(const name& other);                                  \
+                                                                         \
+    double area() const;                                                 \
+    double perimeter() const;                                            \
+    void scale(double factor, double originX, double originY);           \
+    void translate(double x, double y, double z);                        \
+    bool intersects(const name& other, double tolerance) const;          \
+                                                                         \
+    static name unit();                                                  \
+                                                                         \
+  private:                                                               \
+    double _scale;                                                       \
+    int _sides;                                                          \
+    double _origin[3];                                                   \
+  };
+
+#define DECLARE_MODULE(name)                                             \
+  namespace name {                                                       \
+    namespace detail {                                                   \
+      DECLARE_SHAPE(Triangle)                                            \
+      DECLARE_SHAPE(Square)                                              \
+      DECLARE_SHAPE(Pentagon)                                            \
+    }                                                                    \
+    DECLARE_SHAPE(Hexagon)                                               \
+    DECLARE_SHAPE(Octagon)                                               \
+    double total_area(const detail::Triangle& a, const Hexagon& b);      \
+  }
+
+namespace geometry {
+  namespace planar {
+    DECLARE_MODULE(alpha)
+    DECLARE_MODULE(beta)
+    DECLARE_MODULE(gamma)
+    DECLARE_MODULE(delta)
+  }
+
+  namespace spatial {
+    DECLARE_MODULE(alpha)
+    DECLARE_MODULE(beta)
+    DECLARE_MODULE(gamma)
+    DECLARE_MODULE(delta)
+  }
+}
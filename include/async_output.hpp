@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Output streambuf that moves writing to a background thread.  The caller
+// fills the front buffer; when it is full the buffers are swapped and the
+// writer thread pushes the back buffer into the sink (the file, or the codec
+// in front of it) while the caller keeps filling the front one.  The caller
+// only waits if it fills a buffer before the previous one has been written,
+// which bounds memory to the two buffers.
+class AsyncStreamBuf : public std::streambuf {
+public:
+  explicit AsyncStreamBuf(std::streambuf& sink, std::size_t size = 1 << 20)
+    : _sink(sink), _front(size), _back(size), _pending(0), _busy(false), _done(false), _ok(true),
+      _thread(&AsyncStreamBuf::run, this) {
+    setp(_front.data(), _front.data() + _front.size());
+  }
+
+  virtual ~AsyncStreamBuf() {
+    finish();
+  }
+
+  // Hands over what is still buffered, waits until the writer thread has
+  // written everything and stops it.  Returns false if any write failed.
+  bool finish() {
+    if (!_thread.joinable())
+      return _ok;
+
+    handoff(false);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done = true;
+    }
+    _ready.notify_all();
+    _thread.join();
+    return _ok;
+  }
+
+protected:
+  virtual int_type overflow(int_type c) {
+    if (!handoff(false))
+      return traits_type::eof();
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  // A flush really flushes: it returns once the data has been written to the
+  // sink and the sink has been flushed in turn.  The writer thread is idle
+  // once handoff(true) returns, so the sink can be used from here.
+  virtual int sync() {
+    if (!handoff(true))
+      return -1;
+    return _sink.pubsync();
+  }
+
+private:
+  bool handoff(bool wait) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _ready.wait(lock, [this]{ return !_busy; });
+
+    const std::size_t size = pptr() - pbase();
+    if (size > 0 && _thread.joinable()) {
+      std::swap(_front, _back);
+      _pending = size;
+      _busy = true;
+      setp(_front.data(), _front.data() + _front.size());
+      _ready.notify_all();
+
+      if (wait)
+        _ready.wait(lock, [this]{ return !_busy; });
+    }
+    return _ok;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+      _ready.wait(lock, [this]{ return _busy || _done; });
+      if (!_busy)
+        return;
+
+      const std::size_t size = _pending;
+      lock.unlock();
+      const bool ok = _sink.sputn(_back.data(), size) == static_cast<std::streamsize>(size);
+      lock.lock();
+
+      _ok = _ok && ok;
+      _busy = false;
+      _ready.notify_all();
+    }
+  }
+
+  std::streambuf& _sink;
+  std::vector<char> _front;
+  std::vector<char> _back;
+  std::size_t _pending;
+  bool _busy;
+  bool _done;
+  bool _ok;
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::thread _thread;
+};
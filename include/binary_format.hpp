@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of the binary AST dump written by BinaryWriter and read by
+// cleng::binary::File.  Everything is little-endian and 8-byte aligned:
+//
+//   FileHeader
+//   Node      nodes[trailer.nodeCount]
+//   uint32_t  stringOffsets[trailer.stringCount + 1]
+//   char      stringData[]            (each string is NUL terminated)
+//   padding to a multiple of 8
+//   FileTrailer
+//
+// The dump is the same tree the JSON writers produce: one Node per object,
+// array or scalar.  The children of an object or array are stored next to
+// each other, so a container only records the index of its first child and
+// the number of children.  Keys and string values are indices into the string
+// table, which holds every distinct string once.
+//
+// The header and trailer both carry the magic and the version; readers must
+// reject files whose version they do not know.
+namespace cleng {
+namespace binary {
+
+const char Magic[8] = { 'C', 'L', 'E', 'N', 'G', 'A', 'S', 'T' };
+const uint32_t Version = 1;
+const uint32_t NoKey = 0xffffffff;
+
+enum NodeType : uint8_t {
+  Null = 0,
+  False = 1,
+  True = 2,
+  Integer = 3,
+  String = 4,
+  Object = 5,
+  Array = 6
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nodeSize;
+};
+
+// payload holds the integer value, the string index, or, for objects and
+// arrays, the index of the first child in the low 32 bits and the number of
+// children in the high 32 bits.
+struct Node {
+  uint32_t key;
+  uint8_t type;
+  uint8_t reserved[3];
+  uint64_t payload;
+};
+
+struct FileTrailer {
+  uint64_t nodeCount;
+  uint64_t stringCount;
+  uint64_t stringOffsetsOffset;
+  uint64_t stringDataOffset;
+  uint32_t root;
+  uint32_t version;
+  char magic[8];
+};
+
+static_assert(sizeof(FileHeader) == 16, "unexpected FileHeader layout");
+static_assert(sizeof(Node) == 16, "unexpected Node layout");
+static_assert(sizeof(FileTrailer) == 48, "unexpected FileTrailer layout");
+
+}
+}
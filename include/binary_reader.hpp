@@ -0,0 +1,222 @@
+#pragma once
+
+#include "binary_format.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Zero-copy reader for dumps written by BinaryWriter.  File maps the dump and
+// Value walks it in place: no parsing happens on open and nothing is
+// allocated while reading.  Strings are returned as pointers into the mapping
+// and stay valid as long as the File is alive.
+//
+// A truncated or corrupt file must not make the reader touch memory outside
+// the mapping.  open() checks that the sections fit the file and that the
+// string data ends in a NUL; child indices and string indices and offsets
+// are checked as they are followed, and a bad one reads as an invalid Value
+// or a null string.
+//
+//   cleng::binary::File dump;
+//   if (dump.open("output.bin")) {
+//     auto decls = dump.root();
+//     for (uint32_t i = 0; i < decls.size(); ++i)
+//       puts(decls[i].find("name").as_string());
+//   }
+namespace cleng {
+namespace binary {
+
+class File;
+
+class Value {
+public:
+  Value() : _file(nullptr), _node(nullptr) { }
+  Value(const File* file, const Node* node) : _file(file), _node(node) { }
+
+  bool valid() const { return _node != nullptr; }
+  NodeType type() const { return valid() ? static_cast<NodeType>(_node->type) : Null; }
+
+  bool is_null() const { return type() == Null; }
+  bool is_bool() const { return type() == True || type() == False; }
+  bool is_integer() const { return type() == Integer; }
+  bool is_string() const { return type() == String; }
+  bool is_object() const { return type() == Object; }
+  bool is_array() const { return type() == Array; }
+
+  // The key this value is stored under in its parent object, or nullptr for
+  // array elements and the root.
+  inline const char* key() const;
+
+  bool as_bool() const { return type() == True; }
+  int64_t as_integer() const { return is_integer() ? static_cast<int64_t>(_node->payload) : 0; }
+  inline const char* as_string() const;
+
+  // Number of children of an object or array, 0 for scalars.
+  uint32_t size() const {
+    return (is_object() || is_array()) ? static_cast<uint32_t>(_node->payload >> 32) : 0;
+  }
+
+  inline Value operator[](uint32_t index) const;
+
+  // Linear search of an object's children for key.  Returns an invalid Value
+  // if there is none; as with the JSON output, the last matching key wins.
+  inline Value find(const char* key) const;
+
+private:
+  const File* _file;
+  const Node* _node;
+};
+
+class File {
+public:
+  File() : _data(nullptr), _size(0), _nodes(nullptr), _offsets(nullptr), _strings(nullptr), _stringsSize(0), _trailer(nullptr) { }
+
+  ~File() {
+    close();
+  }
+
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  // Maps path and validates the header and trailer.  Returns false if the
+  // file cannot be mapped or is not a dump of a supported version.
+  bool open(const char* path) {
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(FileHeader) + sizeof(FileTrailer)) {
+      ::close(fd);
+      return false;
+    }
+
+    void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+      return false;
+
+    _data = static_cast<const char*>(data);
+    _size = info.st_size;
+
+    if (!validate()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (_data != nullptr)
+      ::munmap(const_cast<char*>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+    _nodes = nullptr;
+    _offsets = nullptr;
+    _strings = nullptr;
+    _stringsSize = 0;
+    _trailer = nullptr;
+  }
+
+  bool is_open() const { return _data != nullptr; }
+
+  Value root() const {
+    return is_open() ? Value(this, _nodes + _trailer->root) : Value();
+  }
+
+  uint64_t node_count() const { return is_open() ? _trailer->nodeCount : 0; }
+  uint64_t string_count() const { return is_open() ? _trailer->stringCount : 0; }
+
+  // nullptr if index is out of range.
+  const Node* node(uint64_t index) const {
+    return index < _trailer->nodeCount ? _nodes + index : nullptr;
+  }
+
+  // nullptr if index or its offset is out of range.
+  const char* string(uint64_t index) const {
+    if (index >= _trailer->stringCount || _offsets[index] >= _stringsSize)
+      return nullptr;
+    return _strings + _offsets[index];
+  }
+
+private:
+  bool validate() {
+    const auto header = reinterpret_cast<const FileHeader*>(_data);
+    if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version || header->nodeSize != sizeof(Node))
+      return false;
+
+    _trailer = reinterpret_cast<const FileTrailer*>(_data + _size - sizeof(FileTrailer));
+    if (std::memcmp(_trailer->magic, Magic, sizeof(Magic)) != 0 || _trailer->version != Version)
+      return false;
+
+    // The counts are bounded by the file size first, so that the offsets
+    // computed from them cannot overflow.
+    const uint64_t end = _size - sizeof(FileTrailer);
+    if (_trailer->nodeCount > end / sizeof(Node) || _trailer->stringCount >= end / sizeof(uint32_t))
+      return false;
+
+    const uint64_t nodesEnd = sizeof(FileHeader) + _trailer->nodeCount * sizeof(Node);
+    if (_trailer->stringOffsetsOffset != nodesEnd ||
+        _trailer->stringDataOffset != _trailer->stringOffsetsOffset + (_trailer->stringCount + 1) * sizeof(uint32_t) ||
+        _trailer->stringDataOffset > end ||
+        _trailer->root >= _trailer->nodeCount)
+      return false;
+
+    // Every string ends in a NUL before the trailer if the last byte of the
+    // string data is one.
+    _stringsSize = end - _trailer->stringDataOffset;
+    if (_trailer->stringCount > 0 && (_stringsSize == 0 || _data[end - 1] != '\0'))
+      return false;
+
+    _nodes = reinterpret_cast<const Node*>(_data + sizeof(FileHeader));
+    _offsets = reinterpret_cast<const uint32_t*>(_data + _trailer->stringOffsetsOffset);
+    _strings = _data + _trailer->stringDataOffset;
+    return true;
+  }
+
+  const char* _data;
+  std::size_t _size;
+  const Node* _nodes;
+  const uint32_t* _offsets;
+  const char* _strings;
+  uint64_t _stringsSize;
+  const FileTrailer* _trailer;
+};
+
+inline const char* Value::key() const {
+  return (valid() && _node->key != NoKey) ? _file->string(_node->key) : nullptr;
+}
+
+inline const char* Value::as_string() const {
+  return is_string() ? _file->string(static_cast<uint32_t>(_node->payload)) : nullptr;
+}
+
+inline Value Value::operator[](uint32_t index) const {
+  if (index >= size())
+    return Value();
+  return Value(_file, _file->node(static_cast<uint64_t>(static_cast<uint32_t>(_node->payload)) + index));
+}
+
+inline Value Value::find(const char* key) const {
+  if (!is_object())
+    return Value();
+
+  Value result;
+  for (uint32_t index = 0; index < size(); ++index) {
+    const auto child = (*this)[index];
+    const auto childKey = child.key();
+    if (childKey != nullptr && std::strcmp(childKey, key) == 0)
+      result = child;
+  }
+  return result;
+}
+
+}
+}
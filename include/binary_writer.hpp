@@ -0,0 +1,154 @@
+#pragma once
+
+#include "writer.hpp"
+#include "binary_format.hpp"
+
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+// Writes the tree in the format described in binary_format.hpp.  Only the
+// direct children of the objects and arrays that are still open are held in
+// memory: when a container closes its children are appended to the node
+// section of the stream and the container itself becomes a child of its
+// parent.  The string table and trailer are written when the outermost
+// container closes.
+class BinaryWriter : public WriterBase<BinaryWriter> {
+public:
+  explicit BinaryWriter(std::ostream& stream) : _stream(stream), _depth(0), _count(0), _key(cleng::binary::NoKey) {
+    cleng::binary::FileHeader header;
+    std::memcpy(header.magic, cleng::binary::Magic, sizeof(header.magic));
+    header.version = cleng::binary::Version;
+    header.nodeSize = sizeof(cleng::binary::Node);
+    _stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  void begin_object() {
+    open(cleng::binary::Object);
+  }
+
+  void end_object() {
+    close();
+  }
+
+  void begin_array() {
+    open(cleng::binary::Array);
+  }
+
+  void end_array() {
+    close();
+  }
+
+  void key(llvm::StringRef key) {
+    _key = _table.intern(key);
+  }
+
+  void value(bool value) {
+    add(value ? cleng::binary::True : cleng::binary::False, 0);
+  }
+
+  void value(int64_t value) {
+    add(cleng::binary::Integer, static_cast<uint64_t>(value));
+  }
+
+  void value(llvm::StringRef value) {
+    add(cleng::binary::String, _table.intern(value));
+  }
+
+  void flush() {
+    _stream.flush();
+  }
+
+private:
+  struct Frame {
+    cleng::binary::Node node;
+    std::vector<cleng::binary::Node> children;
+  };
+
+  static cleng::binary::Node make_node(uint32_t key, uint8_t type, uint64_t payload) {
+    cleng::binary::Node node;
+    node.key = key;
+    node.type = type;
+    std::memset(node.reserved, 0, sizeof(node.reserved));
+    node.payload = payload;
+    return node;
+  }
+
+  void add(uint8_t type, uint64_t payload) {
+    _frames[_depth - 1].children.push_back(make_node(_key, type, payload));
+    _key = cleng::binary::NoKey;
+  }
+
+  // Frames are reused between containers at the same depth, so once the
+  // deepest nesting has been seen no further allocations are needed.
+  void open(uint8_t type) {
+    if (_frames.size() == _depth)
+      _frames.emplace_back();
+
+    auto& frame = _frames[_depth++];
+    frame.node = make_node(_key, type, 0);
+    frame.children.clear();
+    _key = cleng::binary::NoKey;
+  }
+
+  void close() {
+    auto& frame = _frames[--_depth];
+
+    const uint64_t first = _count;
+    const uint64_t count = frame.children.size();
+    write_nodes(frame.children.data(), frame.children.size());
+    frame.node.payload = first | (count << 32);
+
+    if (_depth > 0) {
+      _frames[_depth - 1].children.push_back(frame.node);
+      return;
+    }
+
+    const uint32_t root = _count;
+    write_nodes(&frame.node, 1);
+    finish(root);
+  }
+
+  void write_nodes(const cleng::binary::Node* nodes, std::size_t count) {
+    _stream.write(reinterpret_cast<const char*>(nodes), count * sizeof(cleng::binary::Node));
+    _count += count;
+  }
+
+  void finish(uint32_t root) {
+    const auto& strings = _table.strings();
+
+    cleng::binary::FileTrailer trailer;
+    trailer.nodeCount = _count;
+    trailer.stringCount = strings.size();
+    trailer.stringOffsetsOffset = sizeof(cleng::binary::FileHeader) + _count * sizeof(cleng::binary::Node);
+    trailer.stringDataOffset = trailer.stringOffsetsOffset + (strings.size() + 1) * sizeof(uint32_t);
+
+    uint32_t offset = 0;
+    for (const auto& string : strings) {
+      _stream.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+      offset += string.size() + 1;
+    }
+    _stream.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+
+    // StringTable keeps its strings in a StringMap, which stores a NUL after
+    // every key, so it is written along with it.
+    for (const auto& string : strings)
+      _stream.write(string.data(), string.size() + 1);
+
+    const uint64_t end = trailer.stringDataOffset + offset;
+    const char padding[8] = { 0 };
+    _stream.write(padding, (8 - end % 8) % 8);
+
+    trailer.root = root;
+    trailer.version = cleng::binary::Version;
+    std::memcpy(trailer.magic, cleng::binary::Magic, sizeof(trailer.magic));
+    _stream.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+  }
+
+  std::ostream& _stream;
+  std::vector<Frame> _frames;
+  std::size_t _depth;
+  uint32_t _count;
+  uint32_t _key;
+  StringTable _table;
+};
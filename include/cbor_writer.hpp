@@ -0,0 +1,145 @@
+#pragma once
+
+#include "writer.hpp"
+
+#include <ostream>
+
+#ifdef CLENG_CHECK_KEYS
+#include "llvm/ADT/StringSet.h"
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#endif
+
+// Writes the tree as CBOR (RFC 7049).  Objects and arrays use the
+// indefinite-length encodings, so nothing has to be known about a container
+// before its children are written and the writer streams just like
+// JsonStreamWriter.  The logical content is the same as the JSON output: a
+// generic CBOR decoder yields the same maps, arrays, strings, integers and
+// booleans that JSON.parse does for output.json.  The stream starts with the
+// self-describe tag 55799 so tools can identify the file.
+//
+// A map with a repeated key is not valid CBOR (RFC 7049 section 3.7), and
+// nothing can be taken back once it is streamed, so the writer relies on
+// the visitors writing each key of an object once.  Building with
+// -DCLENG_CHECK_KEYS makes the writer check that they do; the check costs an
+// allocation per key, so it is off by default.
+class CborWriter : public WriterBase<CborWriter> {
+public:
+  explicit CborWriter(std::ostream& stream) : _buffer(stream) {
+    head(Tag, 55799);
+  }
+
+  void begin_object() {
+    open();
+    _buffer.put(static_cast<char>(0xbf));
+  }
+
+  void end_object() {
+    close();
+    _buffer.put(static_cast<char>(0xff));
+  }
+
+  void begin_array() {
+    open();
+    _buffer.put(static_cast<char>(0x9f));
+  }
+
+  void end_array() {
+    close();
+    _buffer.put(static_cast<char>(0xff));
+  }
+
+  void key(llvm::StringRef key) {
+#ifdef CLENG_CHECK_KEYS
+    auto& keys = _keys[_depth - 1];
+    assert(keys.count(key) == 0 && "key written twice into one CBOR map");
+    keys.insert(key);
+#endif
+    string(key);
+  }
+
+  void value(bool value) {
+    _buffer.put(static_cast<char>(value ? 0xf5 : 0xf4));
+  }
+
+  void value(int64_t value) {
+    if (value < 0)
+      head(NegativeInteger, static_cast<uint64_t>(-1 - value));
+    else
+      head(UnsignedInteger, static_cast<uint64_t>(value));
+  }
+
+  void value(llvm::StringRef value) {
+    string(value);
+  }
+
+  void flush() {
+    _buffer.flush();
+  }
+
+private:
+  enum MajorType : uint8_t {
+    UnsignedInteger = 0,
+    NegativeInteger = 1,
+    TextString = 3,
+    Tag = 6
+  };
+
+  // Tracks the keys of each open container; the sets of closed ones are
+  // kept for reuse.
+  void open() {
+#ifdef CLENG_CHECK_KEYS
+    if (_keys.size() == _depth)
+      _keys.emplace_back();
+    _keys[_depth++].clear();
+#endif
+  }
+
+  void close() {
+#ifdef CLENG_CHECK_KEYS
+    --_depth;
+#endif
+  }
+
+  void string(llvm::StringRef value) {
+    head(TextString, value.size());
+    _buffer.append(value);
+  }
+
+  // Initial byte plus the big-endian argument in the shortest form.
+  void head(MajorType type, uint64_t argument) {
+    const char major = static_cast<char>(type << 5);
+    if (argument < 24) {
+      _buffer.put(major | static_cast<char>(argument));
+    }
+    else if (argument <= 0xff) {
+      _buffer.put(major | 24);
+      big_endian(argument, 1);
+    }
+    else if (argument <= 0xffff) {
+      _buffer.put(major | 25);
+      big_endian(argument, 2);
+    }
+    else if (argument <= 0xffffffff) {
+      _buffer.put(major | 26);
+      big_endian(argument, 4);
+    }
+    else {
+      _buffer.put(major | 27);
+      big_endian(argument, 8);
+    }
+  }
+
+  void big_endian(uint64_t value, unsigned bytes) {
+    while (bytes-- > 0)
+      _buffer.put(static_cast<char>(value >> (bytes * 8)));
+  }
+
+  OutputBuffer _buffer;
+#ifdef CLENG_CHECK_KEYS
+  std::vector<llvm::StringSet<>> _keys;
+  std::size_t _depth = 0;
+#endif
+};
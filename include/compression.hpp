@@ -0,0 +1,177 @@
+#pragma once
+
+#include <zlib.h>
+#include <zstd.h>
+
+#include <cstddef>
+#include <streambuf>
+#include <vector>
+
+enum class Codec {
+  None,
+  Gzip,
+  Zstd
+};
+
+// True if level is accepted by codec: 0 to 9 for gzip, 1 to
+// ZSTD_maxCLevel() for zstd.
+inline bool valid_level(Codec codec, long level) {
+  switch (codec) {
+    case Codec::Gzip:
+      return level >= Z_NO_COMPRESSION && level <= Z_BEST_COMPRESSION;
+    case Codec::Zstd:
+      return level >= 1 && level <= ZSTD_maxCLevel();
+    case Codec::None:
+      break;
+  }
+  return false;
+}
+
+// Output streambuf that compresses everything written to it into a sink
+// streambuf.  Data is collected in the put area and handed to the codec
+// whenever the area fills up or the stream is flushed, so compression runs
+// incrementally while the output is produced.  finish() must be called once
+// after the last write to terminate the compressed stream.
+class CompressingStreamBuf : public std::streambuf {
+public:
+  explicit CompressingStreamBuf(std::streambuf& sink) : _output(1 << 17), _sink(sink), _input(1 << 17), _finished(false) {
+    setp(_input.data(), _input.data() + _input.size());
+  }
+
+  virtual ~CompressingStreamBuf() { }
+
+  bool finish() {
+    if (_finished)
+      return true;
+    _finished = true;
+
+    const bool ok = compress(pbase(), pptr() - pbase(), true);
+    setp(_input.data(), _input.data() + _input.size());
+    return ok && _sink.pubsync() == 0;
+  }
+
+protected:
+  // Feeds size bytes to the codec; with finish set the codec also writes its
+  // trailer.  Returns false on codec or sink errors.
+  virtual bool compress(const char* data, std::size_t size, bool finish) = 0;
+
+  bool emit(const char* data, std::size_t size) {
+    return _sink.sputn(data, size) == static_cast<std::streamsize>(size);
+  }
+
+  virtual int_type overflow(int_type c) {
+    if (_finished || !drain())
+      return traits_type::eof();
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  virtual int sync() {
+    if (_finished)
+      return 0;
+    return (drain() && _sink.pubsync() == 0) ? 0 : -1;
+  }
+
+  std::vector<char> _output;
+
+private:
+  bool drain() {
+    const bool ok = compress(pbase(), pptr() - pbase(), false);
+    setp(_input.data(), _input.data() + _input.size());
+    return ok;
+  }
+
+  std::streambuf& _sink;
+  std::vector<char> _input;
+  bool _finished;
+};
+
+class GzipStreamBuf : public CompressingStreamBuf {
+public:
+  GzipStreamBuf(std::streambuf& sink, int level) : CompressingStreamBuf(sink) {
+    _stream.zalloc = Z_NULL;
+    _stream.zfree = Z_NULL;
+    _stream.opaque = Z_NULL;
+    // 15 window bits plus 16 selects the gzip wrapper.
+    _ok = deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+
+  virtual ~GzipStreamBuf() {
+    if (_ok)
+      deflateEnd(&_stream);
+  }
+
+protected:
+  virtual bool compress(const char* data, std::size_t size, bool finish) {
+    if (!_ok)
+      return false;
+
+    _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    _stream.avail_in = size;
+
+    for (;;) {
+      _stream.next_out = reinterpret_cast<Bytef*>(_output.data());
+      _stream.avail_out = _output.size();
+
+      const int result = deflate(&_stream, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (result == Z_STREAM_ERROR)
+        return false;
+      if (!emit(_output.data(), _output.size() - _stream.avail_out))
+        return false;
+
+      if (finish ? result == Z_STREAM_END : _stream.avail_out != 0)
+        return true;
+    }
+  }
+
+private:
+  z_stream _stream;
+  bool _ok;
+};
+
+class ZstdStreamBuf : public CompressingStreamBuf {
+public:
+  ZstdStreamBuf(std::streambuf& sink, int level) : CompressingStreamBuf(sink), _stream(ZSTD_createCStream()) {
+    if (_stream != nullptr && ZSTD_isError(ZSTD_initCStream(_stream, level))) {
+      ZSTD_freeCStream(_stream);
+      _stream = nullptr;
+    }
+  }
+
+  virtual ~ZstdStreamBuf() {
+    if (_stream != nullptr)
+      ZSTD_freeCStream(_stream);
+  }
+
+protected:
+  virtual bool compress(const char* data, std::size_t size, bool finish) {
+    if (_stream == nullptr)
+      return false;
+
+    ZSTD_inBuffer input = { data, size, 0 };
+    while (input.pos < input.size) {
+      ZSTD_outBuffer output = { _output.data(), _output.size(), 0 };
+      if (ZSTD_isError(ZSTD_compressStream(_stream, &output, &input)) || !emit(_output.data(), output.pos))
+        return false;
+    }
+
+    if (!finish)
+      return true;
+
+    for (;;) {
+      ZSTD_outBuffer output = { _output.data(), _output.size(), 0 };
+      const std::size_t remaining = ZSTD_endStream(_stream, &output);
+      if (ZSTD_isError(remaining) || !emit(_output.data(), output.pos))
+        return false;
+      if (remaining == 0)
+        return true;
+    }
+  }
+
+private:
+  ZSTD_CStream* _stream;
+};
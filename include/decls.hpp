@@ -0,0 +1,44 @@
+#pragma once
+
+#include "clang/AST/DeclBase.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <cstdint>
+#include <utility>
+
+// Assigns each decl of a dump a dense id in order of first mention, and
+// remembers which decls have been written in full.  Everywhere else a decl
+// is written as a reference to its id.
+class DeclTable {
+public:
+  static const uint32_t None = ~uint32_t(0);
+
+  struct Entry {
+    uint32_t id;
+    bool emitted;
+    // On the entry of a canonical decl: the id of the first decl of its
+    // redeclaration chain that was written in full, or None.
+    uint32_t first;
+  };
+
+  // The returned reference is only valid until the next call.
+  Entry& entry(const clang::Decl* decl) {
+    Entry fresh = { static_cast<uint32_t>(_entries.size()), false, None };
+    return _entries.insert(std::make_pair(decl, fresh)).first->second;
+  }
+
+  // The id decl was written under, or if it was not written, that of the
+  // first decl of its redeclaration chain that was; None if the dump has
+  // neither.  Unlike entry(), this never assigns an id.
+  uint32_t written(const clang::Decl* decl) const {
+    auto itr = _entries.find(decl);
+    if (itr != _entries.end() && itr->second.emitted)
+      return itr->second.id;
+    itr = _entries.find(decl->getCanonicalDecl());
+    return itr != _entries.end() ? itr->second.first : None;
+  }
+
+private:
+  llvm::DenseMap<const clang::Decl*, Entry> _entries;
+};
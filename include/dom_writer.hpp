@@ -0,0 +1,182 @@
+#pragma once
+
+#include "json_writer.hpp"
+#include "writer.hpp"
+
+#include "llvm/Support/Allocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <vector>
+
+// Builds the whole output as a tree and writes it once the outermost object
+// or array is closed.  Nodes, keys and strings are carved out of a single
+// BumpPtrAllocator, so building the tree costs a pointer bump per node and
+// tearing it down is one Reset() of the arena.  The finished tree is
+// replayed through a JsonStreamWriter.  Objects behave like a map keyed by
+// name: their keys are written in sorted order, and a key written twice
+// into the same object keeps only the value written last.
+class JsonDomWriter : public WriterBase<JsonDomWriter> {
+public:
+  explicit JsonDomWriter(std::ostream& stream) : _stream(stream) {
+    _frames.reserve(64);
+  }
+
+  void begin_object() {
+    open(Node::Object);
+  }
+
+  void end_object() {
+    close();
+  }
+
+  void begin_array() {
+    open(Node::Array);
+  }
+
+  void end_array() {
+    close();
+  }
+
+  void key(llvm::StringRef key) {
+    _key = copy(key);
+  }
+
+  void value(bool value) {
+    add(Node::Bool)->integer = value;
+  }
+
+  void value(int64_t value) {
+    add(Node::Integer)->integer = value;
+  }
+
+  void value(llvm::StringRef value) {
+    add(Node::String)->string = copy(value);
+  }
+
+  void flush() {
+    _stream.flush();
+  }
+
+private:
+  struct Node {
+    enum Kind { Bool, Integer, String, Object, Array };
+
+    Kind kind;
+    int64_t integer;
+    llvm::StringRef key;
+    llvm::StringRef string;
+    Node* first;
+    Node* last;
+    Node* next;
+  };
+
+  llvm::StringRef copy(llvm::StringRef value) {
+    if (value.empty())
+      return llvm::StringRef();
+
+    const auto data = static_cast<char*>(_arena.Allocate(value.size(), 1));
+    std::memcpy(data, value.data(), value.size());
+    return llvm::StringRef(data, value.size());
+  }
+
+  // Appends a node to the innermost open container, or makes it the root.
+  Node* add(Node::Kind kind) {
+    const auto node = new (_arena.Allocate<Node>()) Node();
+    node->kind = kind;
+    node->key = _key;
+    _key = llvm::StringRef();
+
+    if (!_frames.empty()) {
+      auto parent = _frames.back();
+      if (parent->last != nullptr)
+        parent->last->next = node;
+      else
+        parent->first = node;
+      parent->last = node;
+    }
+    return node;
+  }
+
+  void open(Node::Kind kind) {
+    _frames.push_back(add(kind));
+  }
+
+  void close() {
+    const auto node = _frames.back();
+    _frames.pop_back();
+    if (node->kind == Node::Object)
+      sortKeys(*node);
+    if (!_frames.empty())
+      return;
+
+    {
+      JsonStreamWriter out(_stream);
+      replay(out, *node);
+    }
+    _arena.Reset();
+  }
+
+  // Relinks the children of object in key order, dropping all but the last
+  // of each run of equal keys.  The sort is stable, so the last of a run is
+  // the one written last.
+  void sortKeys(Node& object) {
+    _children.clear();
+    for (auto child = object.first; child != nullptr; child = child->next)
+      _children.push_back(child);
+    std::stable_sort(_children.begin(), _children.end(), [](const Node* lhs, const Node* rhs) {
+      return lhs->key < rhs->key;
+    });
+
+    Node* last = nullptr;
+    object.first = nullptr;
+    for (std::size_t i = 0; i < _children.size(); ++i) {
+      if (i + 1 < _children.size() && _children[i + 1]->key == _children[i]->key)
+        continue;
+      if (last != nullptr)
+        last->next = _children[i];
+      else
+        object.first = _children[i];
+      last = _children[i];
+    }
+    if (last != nullptr)
+      last->next = nullptr;
+    object.last = last;
+  }
+
+  static void replay(JsonStreamWriter& out, const Node& node) {
+    switch (node.kind) {
+      case Node::Bool:
+        out.value(node.integer != 0);
+        break;
+      case Node::Integer:
+        out.value(node.integer);
+        break;
+      case Node::String:
+        out.value(node.string);
+        break;
+      case Node::Object:
+        out.begin_object();
+        for (auto child = node.first; child != nullptr; child = child->next) {
+          out.key(child->key);
+          replay(out, *child);
+        }
+        out.end_object();
+        break;
+      case Node::Array:
+        out.begin_array();
+        for (auto child = node.first; child != nullptr; child = child->next)
+          replay(out, *child);
+        out.end_array();
+        break;
+    }
+  }
+
+  std::ostream& _stream;
+  llvm::BumpPtrAllocator _arena;
+  llvm::StringRef _key;
+  std::vector<Node*> _frames;
+  std::vector<Node*> _children;
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#define CLENG_SSE2_KERNEL 1
+#include <immintrin.h>
+#ifdef __has_builtin
+#if __has_builtin(__builtin_cpu_supports)
+#define CLENG_AVX2_KERNEL 1
+#endif
+#endif
+#endif
+
+// Text kernels for the JSON writer: finding the characters of a string that
+// have to be escaped, and formatting integers.
+//
+// find_escape() returns the first '"', '\\' or control character (< 0x20) in
+// [begin, end), or end.  The scan runs 32 bytes at a time with AVX2, 16 with
+// SSE2 and byte by byte otherwise.  SSE2 is part of every x86-64 target; the
+// AVX2 kernel is compiled with a target attribute, so the plugin needs no
+// -mavx2, and is picked once, on first use, if the CPU reports AVX2.
+// Compilers without __builtin_cpu_supports (clang before 3.8, which
+// includes the 3.4 toolchain in defaults.dep) leave the AVX2 kernel out
+// and always use SSE2.
+namespace escape_detail {
+
+typedef const char* (*FindEscape)(const char*, const char*);
+
+inline bool is_special(char c) {
+  return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+inline const char* find_scalar(const char* begin, const char* end) {
+  while (begin != end && !is_special(*begin))
+    ++begin;
+  return begin;
+}
+
+#ifdef CLENG_SSE2_KERNEL
+
+// A byte is special if it equals '"' or '\\', or if min(byte, 0x1f) == byte
+// (an unsigned compare against 0x20, which SSE2 lacks).
+inline const char* find_sse2(const char* begin, const char* end) {
+  const auto quote = _mm_set1_epi8('"');
+  const auto backslash = _mm_set1_epi8('\\');
+  const auto control = _mm_set1_epi8(0x1f);
+
+  for (; end - begin >= 16; begin += 16) {
+    const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    const auto special = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+      _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+  }
+  return find_scalar(begin, end);
+}
+
+#endif
+
+#ifdef CLENG_AVX2_KERNEL
+
+__attribute__((target("avx2")))
+inline const char* find_avx2(const char* begin, const char* end) {
+  const auto quote = _mm256_set1_epi8('"');
+  const auto backslash = _mm256_set1_epi8('\\');
+  const auto control = _mm256_set1_epi8(0x1f);
+
+  for (; end - begin >= 32; begin += 32) {
+    const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    const auto special = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+  }
+  return find_sse2(begin, end);
+}
+
+#endif
+
+inline FindEscape select_kernel() {
+#ifdef CLENG_AVX2_KERNEL
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return find_avx2;
+#endif
+#ifdef CLENG_SSE2_KERNEL
+  return find_sse2;
+#else
+  return find_scalar;
+#endif
+}
+
+}
+
+inline const char* find_escape(const char* begin, const char* end) {
+  static const escape_detail::FindEscape kernel = escape_detail::select_kernel();
+  return kernel(begin, end);
+}
+
+// Writes value escaped for a JSON string (without the quotes) through
+// sink.append(const char*, std::size_t).  Runs without special characters
+// are handed over in one piece.
+template <typename Sink>
+void write_escaped(Sink& sink, llvm::StringRef value) {
+  static const char hex[] = "0123456789abcdef";
+
+  auto begin = value.begin();
+  const auto end = value.end();
+  while (begin != end) {
+    const auto special = find_escape(begin, end);
+    if (special != begin)
+      sink.append(begin, special - begin);
+    if (special == end)
+      break;
+
+    char escaped[6] = { '\\', 0, 0, 0, 0, 0 };
+    std::size_t size = 2;
+    const auto c = static_cast<unsigned char>(*special);
+    switch (c) {
+      case '"': escaped[1] = '"'; break;
+      case '\\': escaped[1] = '\\'; break;
+      case '\b': escaped[1] = 'b'; break;
+      case '\f': escaped[1] = 'f'; break;
+      case '\n': escaped[1] = 'n'; break;
+      case '\r': escaped[1] = 'r'; break;
+      case '\t': escaped[1] = 't'; break;
+      default:
+        escaped[1] = 'u';
+        escaped[2] = '0';
+        escaped[3] = '0';
+        escaped[4] = hex[c >> 4];
+        escaped[5] = hex[c & 0xf];
+        size = 6;
+        break;
+    }
+    sink.append(escaped, size);
+    begin = special + 1;
+  }
+}
+
+// Formats value in decimal into the buffer ending at end and returns the
+// first character written.  20 characters are always enough.  Two digits are
+// produced per division, from a table of the pairs "00" to "99".
+inline char* format_decimal(char* end, int64_t value) {
+  static const char pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+  auto begin = end;
+  uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+  while (magnitude >= 100) {
+    const auto pair = static_cast<unsigned>(magnitude % 100) * 2;
+    magnitude /= 100;
+    begin -= 2;
+    std::memcpy(begin, pairs + pair, 2);
+  }
+  if (magnitude >= 10) {
+    begin -= 2;
+    std::memcpy(begin, pairs + magnitude * 2, 2);
+  }
+  else {
+    *--begin = static_cast<char>('0' + magnitude);
+  }
+
+  if (value < 0)
+    *--begin = '-';
+  return begin;
+}
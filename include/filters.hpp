@@ -0,0 +1,119 @@
+#pragma once
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/SourceManager.h"
+
+#include "llvm/Support/Regex.h"
+
+#include <fnmatch.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Decides which decls are written at all.  Applied to top-level decls and to
+// the children of namespaces and linkage specs before they are visited, so
+// a rejected decl and everything below it costs nothing.
+//
+// A decl is rejected if
+//   - skipSystemHeaders is set and it is in a system header, or is an
+//     implicit decl without a location (the builtin typedefs)
+//   - its file matches no include glob (if there are any) or any exclude
+//     glob; globs are fnmatch patterns in which '*' also matches '/'
+//   - kinds is not empty and does not hold its Decl::getDeclKindName()
+//   - externalOnly is set and it has no external linkage
+//   - its qualified name matches no names regex (if there are any) or any
+//     excludeNames regex
+// Namespaces and linkage specs are only subject to the first two rules;
+// their children are filtered one by one.
+class DeclFilter {
+public:
+  DeclFilter() : skipSystemHeaders(false), externalOnly(false) { }
+
+  bool active() const {
+    return skipSystemHeaders || externalOnly || !kinds.empty() || !_includePaths.empty() ||
+      !_excludePaths.empty() || !_names.empty() || !_excludeNames.empty();
+  }
+
+  void includePath(const std::string& glob) { _includePaths.push_back(glob); }
+
+  void excludePath(const std::string& glob) { _excludePaths.push_back(glob); }
+
+  bool includeName(const std::string& pattern) { return addRegex(_names, pattern); }
+
+  bool excludeName(const std::string& pattern) { return addRegex(_excludeNames, pattern); }
+
+  bool accepts(const clang::Decl& decl, const clang::SourceManager& sm) const {
+    const auto loc = sm.getExpansionLoc(decl.getLocation());
+    if (skipSystemHeaders && (loc.isValid() ? sm.isInSystemHeader(loc) : decl.isImplicit()))
+      return false;
+
+    if (!_includePaths.empty() || !_excludePaths.empty()) {
+      const auto entry = loc.isValid() ? sm.getFileEntryForID(sm.getFileID(loc)) : nullptr;
+      const std::string path = entry != nullptr ? entry->getName() : "";
+      if (!_includePaths.empty() && !matchesGlob(_includePaths, path))
+        return false;
+      if (matchesGlob(_excludePaths, path))
+        return false;
+    }
+
+    if (llvm::isa<clang::NamespaceDecl>(decl) || llvm::isa<clang::LinkageSpecDecl>(decl))
+      return true;
+
+    if (!kinds.empty() && kinds.count(decl.getDeclKindName()) == 0)
+      return false;
+
+    if (!externalOnly && _names.empty() && _excludeNames.empty())
+      return true;
+
+    const auto named = llvm::dyn_cast<clang::NamedDecl>(&decl);
+    if (named == nullptr)
+      return !externalOnly && _names.empty();
+    if (externalOnly && !named->hasExternalFormalLinkage())
+      return false;
+
+    const auto name = named->getQualifiedNameAsString();
+    if (!_names.empty() && !matchesRegex(_names, name))
+      return false;
+    return !matchesRegex(_excludeNames, name);
+  }
+
+  bool skipSystemHeaders;
+  bool externalOnly;
+  std::set<std::string> kinds;
+
+private:
+  typedef std::vector<std::shared_ptr<llvm::Regex>> Regexes;
+
+  static bool addRegex(Regexes& regexes, const std::string& pattern) {
+    auto regex = std::make_shared<llvm::Regex>(pattern);
+    std::string error;
+    if (!regex->isValid(error))
+      return false;
+    regexes.push_back(regex);
+    return true;
+  }
+
+  static bool matchesRegex(const Regexes& regexes, const std::string& name) {
+    for (const auto& regex : regexes) {
+      if (regex->match(name))
+        return true;
+    }
+    return false;
+  }
+
+  static bool matchesGlob(const std::vector<std::string>& globs, const std::string& path) {
+    for (const auto& glob : globs) {
+      if (fnmatch(glob.c_str(), path.c_str(), 0) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  std::vector<std::string> _includePaths;
+  std::vector<std::string> _excludePaths;
+  Regexes _names;
+  Regexes _excludeNames;
+};
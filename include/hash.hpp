@@ -0,0 +1,15 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+// 64-bit FNV-1a.  Unlike llvm::hash_value the result is the same in every
+// process, so it can be used in file names shared between compiler runs.
+inline uint64_t stable_hash(llvm::StringRef data, uint64_t hash = 0xcbf29ce484222325ULL) {
+  for (auto c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
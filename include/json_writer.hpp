@@ -0,0 +1,96 @@
+#pragma once
+
+#include "escape.hpp"
+#include "writer.hpp"
+
+#include <ostream>
+
+// Writes compact JSON text straight into an OutputBuffer.  Nothing is kept
+// per object, so memory use is independent of the size of the tree.  Keys
+// appear in the order they are written and are not checked for duplicates;
+// the visitors write each key of an object once.
+class JsonStreamWriter : public WriterBase<JsonStreamWriter> {
+public:
+  explicit JsonStreamWriter(std::ostream& stream) : _buffer(stream), _separate(false) { }
+
+  void begin_object() {
+    separate();
+    put('{');
+    _separate = false;
+  }
+
+  void end_object() {
+    put('}');
+    _separate = true;
+  }
+
+  void begin_array() {
+    separate();
+    put('[');
+    _separate = false;
+  }
+
+  void end_array() {
+    put(']');
+    _separate = true;
+  }
+
+  void key(llvm::StringRef key) {
+    separate();
+    string(key);
+    put(':');
+    _separate = false;
+  }
+
+  void value(bool value) {
+    separate();
+    append(value ? "true" : "false");
+    _separate = true;
+  }
+
+  void value(int64_t value) {
+    separate();
+    number(value);
+    _separate = true;
+  }
+
+  void value(llvm::StringRef value) {
+    separate();
+    string(value);
+    _separate = true;
+  }
+
+  void flush() {
+    _buffer.flush();
+  }
+
+private:
+  void separate() {
+    if (_separate)
+      put(',');
+  }
+
+  void string(llvm::StringRef value) {
+    put('"');
+    write_escaped(_buffer, value);
+    put('"');
+  }
+
+  void number(int64_t value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* begin = format_decimal(end, value);
+    append(llvm::StringRef(begin, end - begin));
+  }
+
+  void put(char c) {
+    _buffer.put(c);
+  }
+
+  void append(llvm::StringRef data) {
+    _buffer.append(data);
+  }
+
+  OutputBuffer _buffer;
+  bool _separate;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A source position resolved to its spelling file, line and column.
+struct ResolvedLocation {
+  bool valid;
+  clang::FileID file;
+  unsigned line;
+  unsigned column;
+};
+
+// Resolves locations to spelling file, line and column for one translation
+// unit.  What is known about a FileID (its file and dir names, where its
+// lines start) is looked up once and kept, so a location costs a map lookup
+// plus a search of the line starts.  Consecutive lookups tend to land in the
+// same file and near each other, so the last FileID and, per file, the last
+// line are checked before anything else.
+//
+// Lines and columns count like SourceManager's: "\n", "\r", "\r\n" and
+// "\n\r" end a line, and columns are 1-based byte offsets into it.
+class LocationCache {
+public:
+  struct File {
+    llvm::StringRef name;
+    llvm::StringRef dir;
+    llvm::StringRef buffer;
+    std::vector<unsigned> lineStarts;
+    std::size_t lastLine;
+  };
+
+  LocationCache() : _last(nullptr) { }
+
+  ResolvedLocation resolve(const clang::SourceManager& sm, clang::SourceLocation loc) {
+    ResolvedLocation resolved = { false, clang::FileID(), 0, 0 };
+    if (loc.isInvalid())
+      return resolved;
+
+    const auto decomposed = sm.getDecomposedSpellingLoc(loc);
+    auto& info = file(sm, decomposed.first);
+    if (info.lineStarts.empty())
+      indexLines(info);
+
+    const auto line = findLine(info, decomposed.second);
+    resolved.valid = true;
+    resolved.file = decomposed.first;
+    resolved.line = static_cast<unsigned>(line + 1);
+    resolved.column = decomposed.second - info.lineStarts[line] + 1;
+    return resolved;
+  }
+
+  File& file(const clang::SourceManager& sm, clang::FileID id) {
+    if (_last != nullptr && _lastID == id)
+      return *_last;
+
+    auto& slot = _files[id];
+    if (!slot) {
+      slot.reset(new File());
+      slot->lastLine = 0;
+      bool invalid = false;
+      const auto buffer = sm.getBufferData(id, &invalid);
+      if (!invalid)
+        slot->buffer = buffer;
+
+      if (const auto entry = sm.getFileEntryForID(id)) {
+        slot->name = entry->getName();
+        if (entry->getDir() != nullptr)
+          slot->dir = entry->getDir()->getName();
+      }
+    }
+
+    _lastID = id;
+    _last = slot.get();
+    return *_last;
+  }
+
+private:
+  static void indexLines(File& info) {
+    const auto data = info.buffer.data();
+    const auto size = info.buffer.size();
+    info.lineStarts.push_back(0);
+    for (std::size_t i = 0; i < size; ++i) {
+      if (data[i] != '\n' && data[i] != '\r')
+        continue;
+      // A break of two different characters counts once.
+      if (i + 1 < size && (data[i + 1] == '\n' || data[i + 1] == '\r') && data[i + 1] != data[i])
+        ++i;
+      info.lineStarts.push_back(static_cast<unsigned>(i + 1));
+    }
+  }
+
+  // The index of the line holding offset: the last line, the one after it,
+  // or else a binary search.
+  static std::size_t findLine(File& info, unsigned offset) {
+    const auto& starts = info.lineStarts;
+    auto line = info.lastLine;
+    if (starts[line] <= offset && (line + 1 == starts.size() || offset < starts[line + 1]))
+      return line;
+
+    ++line;
+    if (line < starts.size() && starts[line] <= offset && (line + 1 == starts.size() || offset < starts[line + 1])) {
+      info.lastLine = line;
+      return line;
+    }
+
+    line = std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+    info.lastLine = line;
+    return line;
+  }
+
+  llvm::DenseMap<clang::FileID, std::unique_ptr<File>> _files;
+  clang::FileID _lastID;
+  File* _last;
+};
+
+// Per-dump table of the files locations point into.  Lookups are keyed by
+// FileID; entries are shared by every FileID of the same file, so a header
+// included several times is listed once.  Buffers without a file (the
+// predefines, scratch space) share an entry with empty name and dir.
+class FileTable {
+public:
+  struct File {
+    std::string name;
+    std::string dir;
+  };
+
+  uint32_t index(const clang::SourceManager& sm, clang::FileID id) {
+    const auto known = _ids.find(id);
+    if (known != _ids.end())
+      return known->second;
+
+    const auto entry = sm.getFileEntryForID(id);
+    auto result = _entries.insert(std::make_pair(entry, static_cast<uint32_t>(_files.size())));
+    if (result.second) {
+      File file;
+      if (entry != nullptr) {
+        file.name = entry->getName();
+        if (entry->getDir() != nullptr)
+          file.dir = entry->getDir()->getName();
+      }
+      _files.push_back(std::move(file));
+    }
+
+    _ids[id] = result.first->second;
+    return result.first->second;
+  }
+
+  const std::vector<File>& files() const {
+    return _files;
+  }
+
+private:
+  llvm::DenseMap<clang::FileID, uint32_t> _ids;
+  llvm::DenseMap<const clang::FileEntry*, uint32_t> _entries;
+  std::vector<File> _files;
+};
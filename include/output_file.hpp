@@ -0,0 +1,96 @@
+#pragma once
+
+#include "async_output.hpp"
+#include "compression.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <unistd.h>
+
+// The stream a dump is written to: a file, optionally behind a compressing
+// streambuf, optionally behind a background writer thread.  Writers only ever
+// see stream().
+//
+// The data goes to a temporary file next to path that is renamed over path
+// once everything has been written, so readers and concurrent compiler
+// processes never observe a partially written dump.
+class OutputFile {
+public:
+  OutputFile(const std::string& path, Codec codec, int level, bool async)
+    : _path(path), _temporary(path + "." + std::to_string(::getpid()) + ".tmp"), _closed(false), _stream(nullptr) {
+    _file.open(_temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    switch (codec) {
+      case Codec::Gzip:
+        _codec.reset(new GzipStreamBuf(_file, level));
+        break;
+      case Codec::Zstd:
+        _codec.reset(new ZstdStreamBuf(_file, level));
+        break;
+      case Codec::None:
+        break;
+    }
+
+    std::streambuf* sink = _codec ? static_cast<std::streambuf*>(_codec.get()) : &_file;
+    if (async)
+      _async.reset(new AsyncStreamBuf(*sink));
+
+    _stream.rdbuf(_async ? static_cast<std::streambuf*>(_async.get()) : sink);
+  }
+
+  ~OutputFile() {
+    if (!_closed) {
+      _file.close();
+      std::remove(_temporary.c_str());
+    }
+  }
+
+  std::ostream& stream() {
+    return _stream;
+  }
+
+  // Flushes and terminates the compressed stream, closes the file and moves
+  // it into place.  Returns false, leaving path untouched, if anything along
+  // the way failed.
+  bool close() {
+    _closed = true;
+
+    bool ok = static_cast<bool>(_stream.flush());
+    if (_async)
+      ok = _async->finish() && ok;
+    if (_codec)
+      ok = _codec->finish() && ok;
+    ok = _file.close() != nullptr && ok;
+
+    if (ok && std::rename(_temporary.c_str(), _path.c_str()) == 0)
+      return true;
+
+    std::remove(_temporary.c_str());
+    return false;
+  }
+
+  static const char* extension(Codec codec) {
+    switch (codec) {
+      case Codec::Gzip:
+        return ".gz";
+      case Codec::Zstd:
+        return ".zst";
+      case Codec::None:
+        break;
+    }
+    return "";
+  }
+
+private:
+  std::string _path;
+  std::string _temporary;
+  bool _closed;
+  std::filebuf _file;
+  std::unique_ptr<CompressingStreamBuf> _codec;
+  std::unique_ptr<AsyncStreamBuf> _async;
+  std::ostream _stream;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+// The keys to write per decl kind (Decl::getDeclKindName(): "Function",
+// "CXXRecord", ...).  A spec lists "<kind>:<key>,<key>..." items separated by
+// ';'.  Kind "*" covers every kind without an item of its own; decls of other
+// kinds are written in full.  id, ref, canonical and node_type are always
+// written, and objects nested inside a decl (locations, bases, template
+// arguments) are never projected.
+class Projection {
+public:
+  typedef llvm::StringSet<> Fields;
+
+  bool empty() const {
+    return _kinds.empty();
+  }
+
+  bool parse(llvm::StringRef spec) {
+    llvm::SmallVector<llvm::StringRef, 8> items;
+    spec.split(items, ";", -1, false);
+    for (auto item : items) {
+      const auto parts = item.split(':');
+      if (parts.first.empty() || parts.second.empty())
+        return false;
+
+      llvm::SmallVector<llvm::StringRef, 16> keys;
+      parts.second.split(keys, ",", -1, false);
+      auto& fields = _kinds[parts.first];
+      for (auto key : keys)
+        fields.insert(key);
+    }
+    return !items.empty();
+  }
+
+  // Adds one of the predefined specs: "bindings" keeps what a wrapper
+  // generator needs, "index" just enough to build a symbol index.
+  bool profile(llvm::StringRef name) {
+    if (name == "bindings")
+      return parse("*:name,qualifiedName,kind,type,resultType,params,fields,bases,methods,ctors,context,"
+                   "value,hasDefinition,isVirtual,isPure,isStatic,isConst,isVariadic,isDeleted,"
+                   "templateArguments,templateParameters,specializations,templatedDecl,decl,"
+                   "cxxRecordTraits,functionTraits,methodTraits");
+    if (name == "index")
+      return parse("*:name,qualifiedName,kind,sourceRange,context");
+    return false;
+  }
+
+  // The keys to write for a decl of kind, or nullptr to write all of them.
+  const Fields* fields(llvm::StringRef kind) const {
+    if (_kinds.empty())
+      return nullptr;
+
+    auto itr = _kinds.find(kind);
+    if (itr == _kinds.end())
+      itr = _kinds.find("*");
+    return itr != _kinds.end() ? &itr->getValue() : nullptr;
+  }
+
+private:
+  llvm::StringMap<Fields> _kinds;
+};
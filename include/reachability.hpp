@@ -0,0 +1,177 @@
+#pragma once
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/AST/Type.h"
+
+#include "llvm/ADT/DenseSet.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+// The decls reachable from a set of root decls, named by qualified name.  A
+// decl reaches the types it mentions through its type, result and parameter
+// types, bases, template arguments and typedef targets, a record reaches
+// everything declared in it, and a type reaches the record, enum, typedef
+// and template decls it names.  The contexts enclosing a reachable decl
+// (namespaces, linkage specs, records) are reachable too, so that the decl
+// can be written inside them; an enclosing record is written in full, so it
+// is followed like any other reachable decl.
+class Reachability {
+public:
+  Reachability() : _active(false) { }
+
+  bool active() const {
+    return _active;
+  }
+
+  bool contains(const clang::Decl& decl) const {
+    return _reached.count(decl.getCanonicalDecl()) > 0;
+  }
+
+  void compute(const clang::TranslationUnitDecl& tu, const std::set<std::string>& roots) {
+    _active = true;
+
+    std::set<std::string> names;
+    for (const auto& root : roots) {
+      const auto separator = root.rfind("::");
+      names.insert(separator == std::string::npos ? root : root.substr(separator + 2));
+    }
+    findRoots(tu, roots, names);
+
+    while (!_pending.empty()) {
+      const auto decl = _pending.back();
+      _pending.pop_back();
+      follow(*decl);
+    }
+  }
+
+private:
+  // Looks for the roots in namespaces, linkage specs, records and the records
+  // of class templates.  names
+  // holds the unqualified root names, so that only candidates pay for
+  // getQualifiedNameAsString().
+  void findRoots(const clang::DeclContext& dc, const std::set<std::string>& roots, const std::set<std::string>& names) {
+    for (auto itr = dc.decls_begin(); itr != dc.decls_end(); ++itr) {
+      const auto named = llvm::dyn_cast<clang::NamedDecl>(*itr);
+      if (named != nullptr && names.count(named->getNameAsString()) > 0 && roots.count(named->getQualifiedNameAsString()) > 0)
+        add(named);
+
+      if (const auto templ = llvm::dyn_cast<clang::ClassTemplateDecl>(*itr)) {
+        if (templ->getTemplatedDecl() != nullptr)
+          findRoots(*templ->getTemplatedDecl(), roots, names);
+        continue;
+      }
+
+      const auto inner = llvm::dyn_cast<clang::DeclContext>(*itr);
+      if (inner != nullptr && (inner->isFileContext() || inner->isRecord() || inner->getDeclKind() == clang::Decl::LinkageSpec))
+        findRoots(*inner, roots, names);
+    }
+  }
+
+  void add(const clang::Decl* decl) {
+    if (decl == nullptr || !_reached.insert(decl->getCanonicalDecl()).second)
+      return;
+    _pending.push_back(decl);
+
+    const auto dc = decl->getDeclContext();
+    if (dc != nullptr && !dc->isTranslationUnit())
+      add(llvm::cast<clang::Decl>(dc));
+
+    // The record of a class template is written under the template.
+    if (const auto record = llvm::dyn_cast<clang::CXXRecordDecl>(decl))
+      add(record->getDescribedClassTemplate());
+  }
+
+  void follow(const clang::Decl& decl) {
+    if (const auto function = llvm::dyn_cast<clang::FunctionDecl>(&decl)) {
+      addType(function->getResultType());
+      for (auto itr = function->param_begin(); itr != function->param_end(); ++itr)
+        addType((*itr)->getType());
+    }
+    else if (const auto alias = llvm::dyn_cast<clang::TypedefNameDecl>(&decl)) {
+      addType(alias->getUnderlyingType());
+    }
+    else if (const auto value = llvm::dyn_cast<clang::ValueDecl>(&decl)) {
+      addType(value->getType());
+    }
+    else if (const auto templ = llvm::dyn_cast<clang::TemplateDecl>(&decl)) {
+      add(templ->getTemplatedDecl());
+    }
+
+    if (const auto spec = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(&decl)) {
+      add(spec->getSpecializedTemplate());
+      const auto& args = spec->getTemplateArgs();
+      for (unsigned i = 0; i < args.size(); ++i) {
+        if (args[i].getKind() == clang::TemplateArgument::Type)
+          addType(args[i].getAsType());
+      }
+    }
+
+    const auto record = llvm::dyn_cast<clang::RecordDecl>(&decl);
+    const auto definition = record != nullptr ? record->getDefinition() : nullptr;
+    if (definition == nullptr)
+      return;
+
+    for (auto itr = definition->decls_begin(); itr != definition->decls_end(); ++itr)
+      add(*itr);
+
+    if (const auto cxx = llvm::dyn_cast<clang::CXXRecordDecl>(definition)) {
+      for (auto itr = cxx->bases_begin(); itr != cxx->bases_end(); ++itr)
+        addType(itr->getType());
+    }
+  }
+
+  void addType(clang::QualType type) {
+    if (type.isNull())
+      return;
+
+    const auto t = type.getTypePtr();
+    if (const auto alias = llvm::dyn_cast<clang::TypedefType>(t)) {
+      add(alias->getDecl());
+    }
+    else if (const auto tag = llvm::dyn_cast<clang::TagType>(t)) {
+      add(tag->getDecl());
+    }
+    else if (const auto spec = llvm::dyn_cast<clang::TemplateSpecializationType>(t)) {
+      add(spec->getTemplateName().getAsTemplateDecl());
+      for (unsigned i = 0; i < spec->getNumArgs(); ++i) {
+        if (spec->getArg(i).getKind() == clang::TemplateArgument::Type)
+          addType(spec->getArg(i).getAsType());
+      }
+      if (spec->isSugared())
+        addType(spec->desugar());
+    }
+    else if (const auto pointer = llvm::dyn_cast<clang::PointerType>(t)) {
+      addType(pointer->getPointeeType());
+    }
+    else if (const auto reference = llvm::dyn_cast<clang::ReferenceType>(t)) {
+      addType(reference->getPointeeTypeAsWritten());
+    }
+    else if (const auto member = llvm::dyn_cast<clang::MemberPointerType>(t)) {
+      addType(member->getPointeeType());
+      addType(clang::QualType(member->getClass(), 0));
+    }
+    else if (const auto array = llvm::dyn_cast<clang::ArrayType>(t)) {
+      addType(array->getElementType());
+    }
+    else if (const auto function = llvm::dyn_cast<clang::FunctionType>(t)) {
+      addType(function->getResultType());
+      if (const auto proto = llvm::dyn_cast<clang::FunctionProtoType>(t)) {
+        for (auto itr = proto->arg_type_begin(); itr != proto->arg_type_end(); ++itr)
+          addType(*itr);
+      }
+    }
+    else {
+      const auto desugared = t->getLocallyUnqualifiedSingleStepDesugaredType();
+      if (desugared.getTypePtr() != t)
+        addType(desugared);
+    }
+  }
+
+  bool _active;
+  llvm::DenseSet<const clang::Decl*> _reached;
+  std::vector<const clang::Decl*> _pending;
+};
@@ -11,59 +11,723 @@
 #include "clang/AST/ASTContext.h"
 #include "clang/Lex/Preprocessor.h"
 
-#include <serializer/json/json.h>
-#include <serializer/json/impl.h>
-#include <serializer/string_escaper.h>
+#include "binary_writer.hpp"
+#include "cbor_writer.hpp"
+#include "decls.hpp"
+#include "dom_writer.hpp"
+#include "filters.hpp"
+#include "json_writer.hpp"
+#include "locations.hpp"
+#include "projection.hpp"
+#include "reachability.hpp"
+#include "size_writer.hpp"
+#include "tables.hpp"
+#include "traits.hpp"
+#include "types.hpp"
 
 #include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// Switches that change what the visitors emit.
+struct SerializationOptions {
+  // String values are written as ids into the "strings" table.
+  bool internStrings = false;
+
+  // Locations become arrays of integers that refer to the "files" table:
+  //   location: [file, line, column]
+  //   range:    [file, line, column, endLine - line, endColumn']
+  // where endColumn' is endColumn - column if the range ends on the line it
+  // starts on and endColumn otherwise.  A range whose end lies in another
+  // file is written as [file, line, column, endFile, endLine, endColumn].
+  // Invalid locations are [], a range with an invalid end has three entries.
+  bool compactLocations = false;
+
+  // Boolean traits are packed into the bitmasks described in traits.hpp.
+  bool packTraits = false;
+
+  // Types are written as ids into the "types" table (see write_type_entry)
+  // instead of as printed strings.
+  bool typeTable = false;
+
+  // Implicit class template specializations are written as stubs (id, name
+  // and template arguments) unless their template's qualified name is in
+  // specialize or they were instantiated in the main file.
+  bool lazySpecializations = false;
+  std::set<std::string> specialize;
+
+  // Keys to write per decl kind; empty writes everything.
+  Projection projection;
+
+  // Decls to write at all.
+  DeclFilter filter;
+
+  // Qualified names of the decls to start from; if not empty only what is
+  // reachable from them is written (see reachability.hpp).
+  std::set<std::string> roots;
+};
+
+// Tables shared by everything written for one translation unit.
+struct SerializationState {
+  explicit SerializationState(const SerializationOptions& options) : options(options) { }
+
+  bool hasTables() const {
+    return options.compactLocations || options.internStrings || options.packTraits || options.typeTable;
+  }
+
+  const SerializationOptions& options;
+  StringTable strings;
+  LocationCache locations;
+  FileTable files;
+  TypeTable types;
+  DeclTable decls;
+  Reachability reachable;
+
+  // The projection of the decl being written, nullptr if it is written in full.
+  const Projection::Fields* fields = nullptr;
+};
+
+// Sets the projection for an object and restores the enclosing one when the
+// object is done.
+class ProjectionScope {
+public:
+  ProjectionScope(SerializationState& state, const Projection::Fields* fields) : _state(state), _saved(state.fields) {
+    state.fields = fields;
+  }
+
+  ~ProjectionScope() {
+    _state.fields = _saved;
+  }
+
+private:
+  SerializationState& _state;
+  const Projection::Fields* _saved;
+};
+
+// The Context the visitors receive: the clang object being serialized from
+// (ASTContext for decls, Preprocessor for macros) plus the per-dump state.
+template <typename Source>
+struct SerializationContext {
+  SerializationContext(const Source& source, SerializationState& state) : source(source), state(state) { }
+
+  const clang::SourceManager& getSourceManager() const {
+    return source.getSourceManager();
+  }
+
+  const Source& source;
+  SerializationState& state;
+};
 
-template <typename Type, typename Context>
+// JsonVisitor<Type, Context, Writer> serializes a Type through the Writer
+// policy (see writer.hpp).  The VISIT_SPECs below are generic over the
+// writer, so each backend gets its own fully inlined copy of the field list;
+// a backend that needs a different encoding for some Type can specialize
+// JsonVisitor<Type, Context, ItsWriter> without touching the others.
+template <typename Type, typename Context, typename Writer>
 struct JsonVisitor;
 
-template <typename Decl, typename Context>
-void visit(json::Object& obj, const Decl& decl, const Context& ctx) {
-  JsonVisitor<Decl, Context>::visit(obj, decl, ctx);
+template <typename Writer, typename Decl, typename Context>
+void visit(Writer& out, const Decl& decl, const Context& ctx) {
+  JsonVisitor<Decl, Context, Writer>::visit(out, decl, ctx);
 }
 
-template <typename Context> 
-void dispatch_decl(json::Object& obj, const clang::Decl& decl, const Context& ctx) { 
+// True unless the projection of the current decl leaves key out.  Visitors
+// check this before computing a value, not just before writing it.
+template <typename Context>
+bool wants(const Context& ctx, llvm::StringRef key) {
+  const auto fields = ctx.state.fields;
+  return fields == nullptr || fields->count(key) > 0;
+}
+
+// Writes key unless the projection leaves it out, in which case the value
+// is not evaluated.
+#define WRITE_FIELD(key, ...) if (!wants(ctx, key)) { } else out.write(key, __VA_ARGS__)
+
+template <typename Writer, typename Context> 
+void dispatch_decl(Writer& out, const clang::Decl& decl, const Context& ctx) { 
   switch (decl.getKind()) {
     #define ABSTRACT_DECL(DECL)
     #define DECL(CLASS, BASE) \
     case clang::Decl::CLASS: { \
-      ::visit(obj, static_cast<const clang::CLASS##Decl&>(decl), ctx); \
+      ::visit(out, static_cast<const clang::CLASS##Decl&>(decl), ctx); \
       break; \
     }
     #include "clang/AST/DeclNodes.inc"
   }
 };
 
-template <typename Type, typename Context>
-struct JsonVisitor<Type*, Context> {
-  static void visit(json::Object& obj, Type* decl, const Context& ctx) {
-    ::visit(obj, *decl, ctx);
+// Writes value as a nested object under key.
+template <typename Writer, typename Type, typename Context>
+void visit_object(Writer& out, const char* key, const Type& value, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  ProjectionScope scope(ctx.state, nullptr);
+  out.key(key);
+  out.begin_object();
+  ::visit(out, value, ctx);
+  out.end_object();
+}
+
+// Writes each element of [begin, end) as an object of an array under key.
+template <typename Writer, typename Iterator, typename Context>
+void visit_array(Writer& out, const char* key, Iterator begin, Iterator end, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  ProjectionScope scope(ctx.state, nullptr);
+  out.key(key);
+  out.begin_array();
+  for (auto itr = begin; itr != end; ++itr) {
+    out.begin_object();
+    ::visit(out, *itr, ctx);
+    out.end_object();
+  }
+  out.end_array();
+}
+
+// Writes loc under key, as an object or in the compact form.
+template <typename Writer, typename Context>
+void visit_location(Writer& out, const char* key, clang::SourceLocation loc, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  if (!ctx.state.options.compactLocations) {
+    visit_object(out, key, loc, ctx);
+    return;
+  }
+
+  const auto& sm = ctx.getSourceManager();
+  const auto begin = ctx.state.locations.resolve(sm, loc);
+
+  out.key(key);
+  out.begin_array();
+  if (begin.valid) {
+    out.element(ctx.state.files.index(sm, begin.file));
+    out.element(begin.line);
+    out.element(begin.column);
+  }
+  out.end_array();
+}
+
+// Writes range under key, as an object or in the compact form.
+template <typename Writer, typename Context>
+void visit_range(Writer& out, const char* key, clang::SourceRange range, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  if (!ctx.state.options.compactLocations) {
+    visit_object(out, key, range, ctx);
+    return;
+  }
+
+  const auto& sm = ctx.getSourceManager();
+  const auto begin = ctx.state.locations.resolve(sm, range.getBegin());
+  const auto end = ctx.state.locations.resolve(sm, range.getEnd());
+
+  out.key(key);
+  out.begin_array();
+  if (begin.valid) {
+    out.element(ctx.state.files.index(sm, begin.file));
+    out.element(begin.line);
+    out.element(begin.column);
+
+    if (end.valid && end.file == begin.file) {
+      out.element(static_cast<int64_t>(end.line) - begin.line);
+      out.element(end.line == begin.line ? static_cast<int64_t>(end.column) - begin.column : end.column);
+    }
+    else if (end.valid) {
+      out.element(ctx.state.files.index(sm, end.file));
+      out.element(end.line);
+      out.element(end.column);
+    }
+  }
+  out.end_array();
+}
+
+// True if decl is the defining declaration of its redeclaration chain.
+inline bool is_definition(const clang::Decl& decl) {
+  if (const auto tag = llvm::dyn_cast<clang::TagDecl>(&decl))
+    return tag->isThisDeclarationADefinition();
+  if (const auto function = llvm::dyn_cast<clang::FunctionDecl>(&decl))
+    return function->isThisDeclarationADefinition();
+  if (const auto var = llvm::dyn_cast<clang::VarDecl>(&decl))
+    return var->isThisDeclarationADefinition() != clang::VarDecl::DeclarationOnly;
+  if (const auto templ = llvm::dyn_cast<clang::TemplateDecl>(&decl))
+    return templ->getTemplatedDecl() != nullptr && is_definition(*templ->getTemplatedDecl());
+  return false;
+}
+
+// Writes decl in full, with its "id", the first time it is visited and as
+// {"ref": id} every time after that.
+//
+// The first declaration of a redeclaration chain to be written in full is
+// the one the others point at: each later one gets its id as "canonical".
+// That is usually the canonical decl, unless the filter, roots or an
+// implicit declaration kept it out of the dump.  Later declarations that
+// are not the definition are cut down to a stub: node_type, name, id,
+// canonical and sourceRange.  Namespaces are exempt, since each block of a
+// reopened namespace has its own members.
+template <typename Writer, typename Context>
+void visit_decl(Writer& out, const clang::Decl& decl, const Context& ctx) {
+  auto& entry = ctx.state.decls.entry(&decl);
+  if (entry.emitted) {
+    out.write("ref", entry.id);
+    return;
+  }
+
+  entry.emitted = true;
+  const auto id = entry.id;
+  out.write("id", id);
+
+  if (!llvm::isa<clang::NamespaceDecl>(decl)) {
+    const auto canonical = decl.getCanonicalDecl();
+    auto& chain = canonical == &decl ? entry : ctx.state.decls.entry(canonical);
+    if (chain.first == DeclTable::None) {
+      chain.first = id;
+    }
+    else {
+      out.write("canonical", chain.first);
+
+      if (!is_definition(decl)) {
+        ProjectionScope scope(ctx.state, nullptr);
+        out.write("node_type", decl.getDeclKindName());
+        if (const auto named = llvm::dyn_cast<clang::NamedDecl>(&decl))
+          out.write("name", named->getNameAsString());
+        visit_range(out, "sourceRange", decl.getSourceRange(), ctx);
+        return;
+      }
+    }
+  }
+
+  ProjectionScope scope(ctx.state, ctx.state.options.projection.fields(decl.getDeclKindName()));
+  dispatch_decl(out, decl, ctx);
+}
+
+// Writes each decl of [begin, end) through visit_decl as an object of an
+// array under key.
+template <typename Writer, typename Iterator, typename Context>
+void visit_decls(Writer& out, const char* key, Iterator begin, Iterator end, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  out.key(key);
+  out.begin_array();
+  for (auto itr = begin; itr != end; ++itr) {
+    out.begin_object();
+    visit_decl(out, **itr, ctx);
+    out.end_object();
+  }
+  out.end_array();
+}
+
+// Writes decl through visit_decl as an object under key.
+template <typename Writer, typename Context>
+void visit_child(Writer& out, const char* key, const clang::Decl& decl, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  out.key(key);
+  out.begin_object();
+  visit_decl(out, decl, ctx);
+  out.end_object();
+}
+
+// True if decl, a top-level decl or a child of a namespace or linkage spec,
+// passes the decl filter and, with roots, is reachable from them.
+template <typename Context>
+bool selected(const clang::Decl& decl, const Context& ctx) {
+  const auto& filter = ctx.state.options.filter;
+  if (filter.active() && !filter.accepts(decl, ctx.getSourceManager()))
+    return false;
+  return !ctx.state.reachable.active() || ctx.state.reachable.contains(decl);
+}
+
+// True for the contexts whose children are subject to selected(): the
+// translation unit, namespaces and linkage specs.  isFileContext() does not
+// cover linkage specs, although an extern "C" block is just as transparent.
+inline bool selects_children(const clang::DeclContext& dc) {
+  return dc.isFileContext() || dc.getDeclKind() == clang::Decl::LinkageSpec;
+}
+
+// Writes the children of dc under "context".  The children of namespaces and
+// linkage specs are only written if they are selected().
+template <typename Writer, typename Context>
+void visit_context(Writer& out, const clang::DeclContext& dc, const Context& ctx) {
+  if (!wants(ctx, "context"))
+    return;
+
+  const bool filtered = selects_children(dc) && (ctx.state.options.filter.active() || ctx.state.reachable.active());
+
+  out.key("context");
+  out.begin_array();
+  for (auto itr = dc.decls_begin(); itr != dc.decls_end(); ++itr) {
+    if (filtered && !selected(**itr, ctx))
+      continue;
+
+    out.begin_object();
+    visit_decl(out, **itr, ctx);
+    out.end_object();
+  }
+  out.end_array();
+}
+
+// Writes {"ref": id} for each decl of [begin, end).  Used for the member
+// lists of a record, whose decls are written in full under its "context".
+// If the projection leaves "context" out, nothing else writes them, so the
+// list goes through visit_decl instead.
+template <typename Writer, typename Iterator, typename Context>
+void visit_refs(Writer& out, const char* key, Iterator begin, Iterator end, const Context& ctx) {
+  if (!wants(ctx, "context")) {
+    visit_decls(out, key, begin, end, ctx);
+    return;
+  }
+  if (!wants(ctx, key))
+    return;
+
+  out.key(key);
+  out.begin_array();
+  for (auto itr = begin; itr != end; ++itr) {
+    out.begin_object();
+    out.write("ref", ctx.state.decls.entry(*itr).id);
+    out.end_object();
+  }
+  out.end_array();
+}
+
+// True if spec is written in full under lazySpecializations.
+template <typename Context>
+bool wants_specialization(const clang::ClassTemplateSpecializationDecl& spec, const Context& ctx) {
+  const auto& options = ctx.state.options;
+  if (!options.lazySpecializations || spec.isExplicitSpecialization())
+    return true;
+  if (options.specialize.count(spec.getQualifiedNameAsString()) > 0)
+    return true;
+
+  const auto& sm = ctx.getSourceManager();
+  const auto loc = spec.getPointOfInstantiation();
+  return loc.isValid() && sm.getFileID(sm.getExpansionLoc(loc)) == sm.getMainFileID();
+}
+
+// Writes the class template specializations of [begin, end) under key,
+// cutting those that are not wanted down to a stub.  The stub counts as the
+// written form of the specialization: every redeclaration of the template
+// shares the list, and later visits write {"ref": id} like for any decl.
+// Like visit_decl, the stub is recorded as its redeclaration chain's first
+// written decl, or points at that one with "canonical".
+template <typename Writer, typename Iterator, typename Context>
+void visit_specializations(Writer& out, const char* key, Iterator begin, Iterator end, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  out.key(key);
+  out.begin_array();
+  for (auto itr = begin; itr != end; ++itr) {
+    const clang::ClassTemplateSpecializationDecl& spec = **itr;
+    out.begin_object();
+    auto& entry = ctx.state.decls.entry(&spec);
+    if (entry.emitted || wants_specialization(spec, ctx)) {
+      visit_decl(out, spec, ctx);
+    }
+    else {
+      entry.emitted = true;
+      const auto id = entry.id;
+      ProjectionScope scope(ctx.state, nullptr);
+      out.write("id", id);
+
+      auto& chain = ctx.state.decls.entry(spec.getCanonicalDecl());
+      if (chain.first == DeclTable::None)
+        chain.first = id;
+      else
+        out.write("canonical", chain.first);
+
+      out.write("node_type", spec.getDeclKindName());
+      out.write("name", spec.getNameAsString());
+      out.write("isLazy", true);
+      ::visit(out, spec.getTemplateArgs(), ctx);
+    }
+    out.end_object();
+  }
+  out.end_array();
+}
+
+// Writes type as an id into the "types" table or as its printed name.
+template <typename Writer, typename Context>
+void visit_type(Writer& out, const char* key, clang::QualType type, const Context& ctx) {
+  if (!wants(ctx, key))
+    return;
+
+  if (ctx.state.options.typeTable)
+    out.write(key, ctx.state.types.index(type));
+  else
+    out.write(key, type.getAsString());
+}
+
+// Writes the id of decl in the dump under key, or nothing if the dump does
+// not have it.
+template <typename Writer>
+void write_decl_id(Writer& out, const char* key, const SerializationState& state, const clang::Decl* decl) {
+  if (decl == nullptr)
+    return;
+  const auto id = state.decls.written(decl);
+  if (id != DeclTable::None)
+    out.write(key, id);
+}
+
+inline const char* template_argument_kind(const clang::TemplateArgument& arg) {
+  switch (arg.getKind()) {
+    case clang::TemplateArgument::Null: return "Null";
+    case clang::TemplateArgument::Type: return "Type";
+    case clang::TemplateArgument::Declaration: return "Declaration";
+    case clang::TemplateArgument::NullPtr: return "NullPtr";
+    case clang::TemplateArgument::Integral: return "Integral";
+    case clang::TemplateArgument::Template: return "Template";
+    case clang::TemplateArgument::TemplateExpansion: return "TemplateExpansion";
+    case clang::TemplateArgument::Expression: return "Expression";
+    case clang::TemplateArgument::Pack: return "Pack";
+  }
+  return "";
+}
+
+// One argument of a TemplateSpecialization entry in the "types" table.
+template <typename Writer>
+void write_template_argument(Writer& out, SerializationState& state, const clang::TemplateArgument& arg) {
+  out.begin_object();
+  out.write("kind", template_argument_kind(arg));
+  switch (arg.getKind()) {
+    case clang::TemplateArgument::Type:
+      out.write("type", state.types.index(arg.getAsType()));
+      break;
+    case clang::TemplateArgument::Integral:
+      out.write("value", arg.getAsIntegral().getExtValue());
+      break;
+    case clang::TemplateArgument::Declaration:
+      write_decl_id(out, "decl", state, arg.getAsDecl());
+      break;
+    case clang::TemplateArgument::Template:
+      write_decl_id(out, "template", state, arg.getAsTemplate().getAsTemplateDecl());
+      break;
+    case clang::TemplateArgument::Pack:
+      out.key("pack");
+      out.begin_array();
+      for (auto itr = arg.pack_begin(); itr != arg.pack_end(); ++itr)
+        write_template_argument(out, state, *itr);
+      out.end_array();
+      break;
+    case clang::TemplateArgument::Null:
+      break;
+    default: {
+      std::string printed;
+      llvm::raw_string_ostream stream(printed);
+      arg.print(clang::PrintingPolicy(clang::LangOptions()), stream);
+      out.write("expression", stream.str());
+      break;
+    }
+  }
+  out.end_object();
+}
+
+// Writes one entry of the "types" table.  Every entry has a "kind": the
+// clang type class name, or "Qualified" for a type with local cv-qualifiers.
+// Related types are referred to by id, which may append further entries:
+//   Qualified:               isConst, isVolatile, isRestrict, type
+//   Pointer, references:     pointee
+//   MemberPointer:           pointee, class
+//   arrays:                  element, and size for ConstantArray
+//   FunctionProto:           result, params, isVariadic, isConst
+//   FunctionNoProto:         result
+//   Record, Enum:            name (qualified name of the decl), decl
+//   Typedef:                 name, type (the aliased type)
+//   TemplateSpecialization:  name, template, args, and type for an alias
+//                            template
+//   Builtin:                 name
+// Other sugar has a type with one level of sugar removed; remaining leaf
+// types (template parameters and other dependent types) have their printed
+// name.  Entries for sugared types also carry their canonical type.
+//
+// "decl" and "template" are the ids of the decls in the dump (see
+// DeclTable::written) and are left out for decls the dump does not have.
+// Each of "args" is an object with the argument's "kind" and, depending on
+// it, its "type", integral "value", "decl", "template", "pack" of further
+// arguments, or the printed "expression".
+template <typename Writer>
+void write_type_entry(Writer& out, SerializationState& state, clang::QualType type) {
+  auto& types = state.types;
+  out.begin_object();
+  if (type.isNull()) {
+    out.write("kind", "Null");
+  }
+  else if (type.hasLocalQualifiers()) {
+    out.write("kind", "Qualified");
+    out.write("isConst", type.isLocalConstQualified());
+    out.write("isVolatile", type.isLocalVolatileQualified());
+    out.write("isRestrict", type.isLocalRestrictQualified());
+    out.write("type", types.index(type.getLocalUnqualifiedType()));
+  }
+  else {
+    const auto t = type.getTypePtr();
+    out.write("kind", t->getTypeClassName());
+
+    if (const auto pointer = llvm::dyn_cast<clang::PointerType>(t)) {
+      out.write("pointee", types.index(pointer->getPointeeType()));
+    }
+    else if (const auto reference = llvm::dyn_cast<clang::ReferenceType>(t)) {
+      out.write("pointee", types.index(reference->getPointeeTypeAsWritten()));
+    }
+    else if (const auto member = llvm::dyn_cast<clang::MemberPointerType>(t)) {
+      out.write("pointee", types.index(member->getPointeeType()));
+      out.write("class", types.index(clang::QualType(member->getClass(), 0)));
+    }
+    else if (const auto array = llvm::dyn_cast<clang::ArrayType>(t)) {
+      out.write("element", types.index(array->getElementType()));
+      if (const auto constant = llvm::dyn_cast<clang::ConstantArrayType>(t))
+        out.write("size", constant->getSize().getZExtValue());
+    }
+    else if (const auto function = llvm::dyn_cast<clang::FunctionType>(t)) {
+      out.write("result", types.index(function->getResultType()));
+      if (const auto proto = llvm::dyn_cast<clang::FunctionProtoType>(t)) {
+        out.key("params");
+        out.begin_array();
+        for (auto itr = proto->arg_type_begin(); itr != proto->arg_type_end(); ++itr)
+          out.element(types.index(*itr));
+        out.end_array();
+        out.write("isVariadic", proto->isVariadic());
+        out.write("isConst", (proto->getTypeQuals() & clang::Qualifiers::Const) != 0);
+      }
+    }
+    else if (const auto tag = llvm::dyn_cast<clang::TagType>(t)) {
+      out.write("name", tag->getDecl()->getQualifiedNameAsString());
+      write_decl_id(out, "decl", state, tag->getDecl());
+    }
+    else if (const auto specialization = llvm::dyn_cast<clang::TemplateSpecializationType>(t)) {
+      const auto templ = specialization->getTemplateName().getAsTemplateDecl();
+      if (templ != nullptr) {
+        out.write("name", templ->getQualifiedNameAsString());
+        write_decl_id(out, "template", state, templ);
+      }
+      else {
+        out.write("name", type.getAsString());
+      }
+      out.key("args");
+      out.begin_array();
+      for (auto itr = specialization->begin(); itr != specialization->end(); ++itr)
+        write_template_argument(out, state, *itr);
+      out.end_array();
+      if (specialization->isTypeAlias())
+        out.write("type", types.index(specialization->getAliasedType()));
+    }
+    else if (const auto alias = llvm::dyn_cast<clang::TypedefType>(t)) {
+      out.write("name", alias->getDecl()->getQualifiedNameAsString());
+      out.write("type", types.index(alias->desugar()));
+    }
+    else {
+      const auto desugared = t->getLocallyUnqualifiedSingleStepDesugaredType();
+      if (desugared.getTypePtr() != t)
+        out.write("type", types.index(desugared));
+      else
+        out.write("name", type.getAsString());
+    }
+
+    if (!t->isCanonicalUnqualified())
+      out.write("canonical", types.index(t->getCanonicalTypeInternal()));
+  }
+  out.end_object();
+}
+
+#define WRITE_TRAIT_NAME(key, ...) out.value(#key);
+
+#define WRITE_TRAIT_LEVEL(levelKey, LIST)                                      \
+  out.key(levelKey);                                                           \
+  out.begin_array();                                                           \
+  LIST(WRITE_TRAIT_NAME)                                                       \
+  out.end_array();
+
+// Writes the tables collected in state.  Strings go last since writing the
+// other tables may still add to them.
+template <typename Writer>
+void write_tables(Writer& out, SerializationState& state) {
+  if (state.options.compactLocations) {
+    out.key("files");
+    out.begin_array();
+    for (const auto& file : state.files.files()) {
+      out.begin_object();
+      out.write("file", file.name);
+      out.write("dir", file.dir);
+      out.end_object();
+    }
+    out.end_array();
+  }
+
+  if (state.options.typeTable) {
+    out.key("types");
+    out.begin_array();
+    for (std::size_t id = 0; id < state.types.types().size(); ++id)
+      write_type_entry(out, state, state.types.types()[id]);
+    out.end_array();
+  }
+
+  if (state.options.packTraits) {
+    out.key("traits");
+    out.begin_object();
+    TRAIT_LEVELS(WRITE_TRAIT_LEVEL)
+    out.end_object();
+  }
+
+  if (state.options.internStrings) {
+    out.key("strings");
+    out.begin_array();
+    for (const auto& string : state.strings.strings())
+      out.value(string);
+    out.end_array();
+  }
+}
+
+template <typename Type, typename Context, typename Writer>
+struct JsonVisitor<Type*, Context, Writer> {
+  static void visit(Writer& out, Type* decl, const Context& ctx) {
+    ::visit(out, *decl, ctx);
   }
 };
 
 #define VISIT_SPEC(Type, ...)                                                  \
-template <typename Context>                                                    \
-struct JsonVisitor<Type, Context> {                                            \
-  static void visit(json::Object& obj, const Type& decl, const Context& ctx) {   \
+template <typename Context, typename Writer>                                   \
+struct JsonVisitor<Type, Context, Writer> {                                    \
+  static void visit(Writer& out, const Type& decl, const Context& ctx) {       \
     __VA_ARGS__                                                                \
   }                                                                            \
 };
 
+#define WRITE_TRAIT(key, ...) WRITE_FIELD(#key, __VA_ARGS__);
+
+#define PACK_TRAIT(key, ...) traits.add(__VA_ARGS__);
+
+// Writes the traits in LIST one key each, or packed into masks under
+// levelKey (see traits.hpp).
+#define WRITE_TRAITS(levelKey, LIST)                                           \
+  if (ctx.state.options.packTraits) {                                          \
+    if (wants(ctx, levelKey)) {                                                \
+      TraitMask traits;                                                        \
+      LIST(PACK_TRAIT)                                                         \
+      traits.write(out, levelKey);                                             \
+    }                                                                          \
+  }                                                                            \
+  else {                                                                       \
+    LIST(WRITE_TRAIT)                                                          \
+  }
+
 #define DEFAULT_VISIT_SPEC(Type) \
-VISIT_SPEC(Type, obj["internal_type"] = #Type;);
+VISIT_SPEC(Type, out.write("internal_type", #Type););
 
 DEFAULT_VISIT_SPEC(clang::AccessSpecDecl);
 
 DEFAULT_VISIT_SPEC(clang::BlockDecl);
 
 VISIT_SPEC(clang::ClassScopeFunctionSpecializationDecl,
-  obj["specialization"] = true;
+  WRITE_FIELD("specialization", true);
 
-  ::visit(obj, static_cast<const clang::Decl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::Decl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::FileScopeAsmDecl);
@@ -75,21 +739,21 @@ DEFAULT_VISIT_SPEC(clang::FriendTemplateDecl);
 DEFAULT_VISIT_SPEC(clang::ImportDecl);
 
 VISIT_SPEC(clang::LinkageSpecDecl,
-  obj["language"] = (decl.getLanguage() == clang::LinkageSpecDecl::lang_cxx) ? "c++" : "c";
+  WRITE_FIELD("language", (decl.getLanguage() == clang::LinkageSpecDecl::lang_cxx) ? "c++" : "c");
 
-  ::visit(obj, static_cast<const clang::Decl&>(decl), ctx);
-  ::visit(obj, static_cast<const clang::DeclContext&>(decl), ctx);
+  ::visit(out, static_cast<const clang::Decl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::DeclContext&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::LabelDecl);
 
 VISIT_SPEC(clang::NamespaceDecl,
-  obj["isAnonymousNamespace"] = decl.isAnonymousNamespace();
-  obj["isInline"] = decl.isInline();
-  obj["isOriginalNamespace"] = decl.isOriginalNamespace();
+  WRITE_FIELD("isAnonymousNamespace", decl.isAnonymousNamespace());
+  WRITE_FIELD("isInline", decl.isInline());
+  WRITE_FIELD("isOriginalNamespace", decl.isOriginalNamespace());
 
-  ::visit(obj, static_cast<const clang::NamedDecl&>(decl), ctx);
-  ::visit(obj, static_cast<const clang::DeclContext&>(decl), ctx);
+  ::visit(out, static_cast<const clang::NamedDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::DeclContext&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::NamespaceAliasDecl);
@@ -119,102 +783,66 @@ DEFAULT_VISIT_SPEC(clang::MSPropertyDecl);
 DEFAULT_VISIT_SPEC(clang::OMPThreadPrivateDecl);
 
 VISIT_SPEC(clang::TemplateArgumentList,
-  json::Array arguments;
-  for (auto idx = 0; idx < decl.size(); ++idx) {
-    json::Object argument;
-    ::visit(argument, decl[idx], ctx);
-    arguments.emplace_back(argument);
-  }
-  obj["templateArguments"] = arguments;
+  visit_array(out, "templateArguments", decl.data(), decl.data() + decl.size(), ctx);
 );
 
 VISIT_SPEC(clang::TemplateArgument,
-  obj["isNull"] = decl.isNull();
-  obj["isDependent"] = decl.isDependent();
-  obj["isInstantiationDependent"] = decl.isInstantiationDependent();
-  obj["containsUnexpandedParameterPack"] = decl.containsUnexpandedParameterPack();
-  obj["isPackExpansion"] = decl.isPackExpansion();
-  obj["type"] = decl.getAsType().getAsString();
-
-  const auto val = decl.getAsDecl();
-  if (val)
-    ::visit(obj, *val, ctx);
-
-  obj["isDeclForReferenceParam"] = decl.isDeclForReferenceParam();
-
-  if (decl.pack_size() > 0) {
-    json::Array parameter_pack;
-    for (auto itr = decl.pack_begin(); itr != decl.pack_end(); ++itr) {
-      json::Object param;
-      ::visit(param, *itr, ctx);
-      parameter_pack.emplace_back(param);
-    }
-    obj["parameterPack"] = parameter_pack;
+  out.write("isNull", decl.isNull());
+  out.write("isDependent", decl.isDependent());
+  out.write("isInstantiationDependent", decl.isInstantiationDependent());
+  out.write("containsUnexpandedParameterPack", decl.containsUnexpandedParameterPack());
+  out.write("isPackExpansion", decl.isPackExpansion());
+  // The argument's decl goes under its own key: written inline it would
+  // repeat "type" and every other ValueDecl key in this object.
+  if (decl.getKind() == clang::TemplateArgument::Type)
+    visit_type(out, "type", decl.getAsType(), ctx);
+  else if (decl.getKind() == clang::TemplateArgument::Declaration) {
+    visit_child(out, "decl", *decl.getAsDecl(), ctx);
+    out.write("isDeclForReferenceParam", decl.isDeclForReferenceParam());
   }
+
+  if (decl.pack_size() > 0)
+    visit_array(out, "parameterPack", decl.pack_begin(), decl.pack_end(), ctx);
 );
 
 VISIT_SPEC(clang::TemplateParameterList,
-  json::Array parameters;
-  for (const auto& declItr : decl) {
-    json::Object parameter;
-    ::visit(parameter, *declItr, ctx);
-    parameters.emplace_back(parameter);
-  }
-  obj["templateParameters"] = parameters;
+  visit_array(out, "templateParameters", decl.begin(), decl.end(), ctx);
 );
 
 VISIT_SPEC(clang::TemplateDecl,
   const auto templateParamList = decl.getTemplateParameters();
   if (templateParamList != nullptr)
-    ::visit(obj, *templateParamList, ctx);
+    ::visit(out, *templateParamList, ctx);
 
-  ::visit(obj, static_cast<const clang::NamedDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::NamedDecl&>(decl), ctx);
 )
 
 VISIT_SPEC(clang::ClassTemplateDecl,
-  obj["isThisDeclarationADefinition"] = decl.isThisDeclarationADefinition();
+  WRITE_FIELD("isThisDeclarationADefinition", decl.isThisDeclarationADefinition());
 
-  json::Array specializations;
   auto& cdecl = const_cast<clang::ClassTemplateDecl&>(decl);
-  for (auto itr = cdecl.spec_begin(); itr != cdecl.spec_end(); ++itr) {
-    json::Object specialization;
-    ::visit(specialization, *itr, ctx);
-    specializations.emplace_back(specialization);
-  }
-  obj["specializations"] = specializations;
+  visit_specializations(out, "specializations", cdecl.spec_begin(), cdecl.spec_end(), ctx);
 
-  json::Array partial_specializations;
-  for (auto itr = cdecl.partial_spec_begin(); itr != cdecl.partial_spec_end(); ++itr) {
-    json::Object partial_specialization;
-    ::visit(partial_specialization, *itr, ctx);
-    partial_specializations.emplace_back(partial_specialization);
-  }
-  obj["partial_specializations"] = partial_specializations;
+  visit_decls(out, "partial_specializations", cdecl.partial_spec_begin(), cdecl.partial_spec_end(), ctx);
 
-  ::visit(obj, decl.getTemplatedDecl(), ctx);
-  ::visit(obj, static_cast<const clang::RedeclarableTemplateDecl&>(decl), ctx);
+  visit_child(out, "templatedDecl", *decl.getTemplatedDecl(), ctx);
+  ::visit(out, static_cast<const clang::RedeclarableTemplateDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::FunctionTemplateDecl,
-  obj["isThisDeclarationADefinition"] = decl.isThisDeclarationADefinition();
+  WRITE_FIELD("isThisDeclarationADefinition", decl.isThisDeclarationADefinition());
 
-  json::Array specializations;
   auto& cdecl = const_cast<clang::FunctionTemplateDecl&>(decl);
-  for (auto itr = cdecl.spec_begin(); itr != cdecl.spec_end(); ++itr) {
-    json::Object specialization;
-    ::visit(specialization, *itr, ctx);
-    specializations.emplace_back(specialization);
-  }
-  obj["specializations"] = specializations;
+  visit_decls(out, "specializations", cdecl.spec_begin(), cdecl.spec_end(), ctx);
 
-  ::visit(obj, *decl.getTemplatedDecl(), ctx);
-  ::visit(obj, static_cast<const clang::RedeclarableTemplateDecl&>(decl), ctx);
+  visit_child(out, "templatedDecl", *decl.getTemplatedDecl(), ctx);
+  ::visit(out, static_cast<const clang::RedeclarableTemplateDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::RedeclarableTemplateDecl,
-  obj["isMemberSpecialization"] = const_cast<clang::RedeclarableTemplateDecl&>(decl).isMemberSpecialization();
+  WRITE_FIELD("isMemberSpecialization", const_cast<clang::RedeclarableTemplateDecl&>(decl).isMemberSpecialization());
 
-  ::visit(obj, static_cast<const clang::TemplateDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::TemplateDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::TypeAliasTemplateDecl);
@@ -228,194 +856,80 @@ VISIT_SPEC(clang::TypeDecl,
   if (type) {
 
   }
-  //obj["type"] = decl.getTypeForDecl()->getCanonicalTypeInternal().getAsString();
+  //out.write("type", decl.getTypeForDecl()->getCanonicalTypeInternal().getAsString());
 
-  ::visit(obj, static_cast<const clang::NamedDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::NamedDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::TagDecl,
   // TagDecl
-  obj["isThisDeclarationADefinition"] = decl.isThisDeclarationADefinition();
-  obj["isCompleteDefinition"] = decl.isCompleteDefinition();
-  obj["isBeingDefined"] = decl.isBeingDefined();
-  obj["isEmbeddedInDeclarator"] = decl.isEmbeddedInDeclarator();
-  obj["isFreeStanding"] = decl.isFreeStanding();
-  obj["isDependentType"] = decl.isDependentType();
-  obj["kind"] = decl.getKindName();
-  obj["isStruct"] = decl.isStruct();
-  obj["isInterface"] = decl.isInterface();
-  obj["isClass"] = decl.isClass();
-  obj["isUnion"] = decl.isUnion();
-  obj["isEnum"] = decl.isEnum();
-  //obj["hasNameForLinkage"] = decl.hasNameForLinkage();
-
-  ::visit(obj, static_cast<const clang::TypeDecl&>(decl), ctx);
-  ::visit(obj, static_cast<const clang::DeclContext&>(decl), ctx);  
+  WRITE_FIELD("kind", decl.getKindName());
+  WRITE_TRAITS("tagTraits", TAG_DECL_TRAITS)
+  //out.write("hasNameForLinkage", decl.hasNameForLinkage());
+
+  ::visit(out, static_cast<const clang::TypeDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::DeclContext&>(decl), ctx);  
 );
 
 VISIT_SPEC(clang::RecordDecl,
   // RecordDecl
-  obj["hasFlexibleArrayMember"] = decl.hasFlexibleArrayMember();
-  obj["isAnonymousStructOrUnion"] = decl.isAnonymousStructOrUnion();
-  obj["hasObjectMember"] = decl.hasObjectMember();
-  //obj["hasVolatileMember"] = decl.hasVolatileMember();
-  obj["isInjectedClassName"] = decl.isInjectedClassName();
+  //out.write("hasVolatileMember", decl.hasVolatileMember());
+  WRITE_TRAITS("recordTraits", RECORD_DECL_TRAITS)
 
-  json::Array fields;
-  for (auto itr = decl.field_begin(); itr != decl.field_end(); ++itr) {
-    json::Object field;
-    ::visit(field, *itr, ctx);
-    fields.emplace_back(field);
-  }
-  obj["fields"] = fields;
+  visit_refs(out, "fields", decl.field_begin(), decl.field_end(), ctx);
 
-  ::visit(obj, static_cast<const clang::TagDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::TagDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXRecordDecl,
   // CXXRecordDecl
-  obj["hasDefinition"] = decl.hasDefinition();
-
-  if (obj["hasDefinition"].as<bool>()) {
-
-  obj["isDynamicClass"] = decl.isDynamicClass();
-  obj["hasAnyDependentBases"] = decl.hasAnyDependentBases();
-  obj["hasFriends"] = decl.hasFriends();
-  obj["hasSimpleMoveConstructor"] = decl.hasSimpleMoveConstructor();
-  obj["hasSimpleMoveAssignment"] = decl.hasSimpleMoveAssignment();
-  obj["hasSimpleDestructor"] = decl.hasSimpleDestructor();
-  obj["hasDefaultConstructor"] = decl.hasDefaultConstructor();
-  obj["needsImplicitDefaultConstructor"] = decl.needsImplicitDefaultConstructor();
-  obj["hasUserDeclaredConstructor"] = decl.hasUserDeclaredConstructor();
-  obj["hasUserProvidedDefaultConstructor"] = decl.hasUserProvidedDefaultConstructor();
-  obj["hasUserDeclaredCopyConstructor"] = decl.hasUserDeclaredCopyConstructor();
-  obj["needsImplicitCopyConstructor"] = decl.needsImplicitCopyConstructor();
-  obj["needsOverloadResolutionForCopyConstructor"] = decl.needsOverloadResolutionForCopyConstructor();
-  obj["implicitCopyConstructorHasConstParam"] = decl.implicitCopyConstructorHasConstParam();
-  obj["hasCopyConstructorWithConstParam"] = decl.hasCopyConstructorWithConstParam();
-  obj["hasUserDeclaredMoveOperation"] = decl.hasUserDeclaredMoveOperation();
-  obj["hasUserDeclaredMoveConstructor"] = decl.hasUserDeclaredMoveConstructor();
-  obj["hasMoveConstructor"] = decl.hasMoveConstructor();
-  obj["hasFailedImplicitMoveConstructor"] = decl.hasFailedImplicitMoveConstructor();
-  obj["needsImplicitMoveConstructor"] = decl.needsImplicitMoveConstructor();
-  obj["needsOverloadResolutionForMoveConstructor"] = decl.needsOverloadResolutionForMoveConstructor();
-  obj["hasUserDeclaredCopyAssignment"] = decl.hasUserDeclaredCopyAssignment();
-  obj["needsImplicitCopyAssignment"] = decl.needsImplicitCopyAssignment();
-  obj["needsOverloadResolutionForCopyAssignment"] = decl.needsOverloadResolutionForCopyAssignment();
-  obj["implicitCopyAssignmentHasConstParam"] = decl.implicitCopyAssignmentHasConstParam();
-  obj["hasCopyAssignmentWithConstParam"] = decl.hasCopyAssignmentWithConstParam();
-  obj["hasUserDeclaredMoveAssignment"] = decl.hasUserDeclaredMoveAssignment();
-  obj["hasMoveAssignmeTnt"] = decl.hasMoveAssignment();
-  obj["hasFailedImplicitMoveAssignment"] = decl.hasFailedImplicitMoveAssignment();
-  obj["needsImplicitMoveAssignment"] = decl.needsImplicitMoveAssignment();
-  obj["needsOverloadResolutionForMoveAssignment"] = decl.needsOverloadResolutionForMoveAssignment();
-  obj["hasUserDeclaredDestructor"] = decl.hasUserDeclaredDestructor();
-  obj["needsImplicitDestructor"] = decl.needsImplicitDestructor();
-  obj["needsOverloadResolutionForDestructor"] = decl.needsOverloadResolutionForDestructor();
-  obj["isLambda"] = decl.isLambda();
-  obj["isAggregate"] = decl.isAggregate();
-  obj["hasInClassInitializer"] = decl.hasInClassInitializer();
-  obj["hasUninitializedReferenceMember"] = decl.hasUninitializedReferenceMember();
-  obj["isPOD"] = decl.isPOD();
-  obj["isCLike"] = decl.isCLike();
-  obj["isEmpty"] = decl.isEmpty();
-  obj["isPolymorphic"] = decl.isPolymorphic();
-  obj["isAbstract"] = decl.isAbstract();
-  obj["isStandardLayout"] = decl.isStandardLayout();
-  obj["hasMutableFields"] = decl.hasMutableFields();
-  obj["hasTrivialDefaultConstructor"] = decl.hasTrivialDefaultConstructor();
-  obj["hasNonTrivialDefaultConstructor"] = decl.hasNonTrivialDefaultConstructor();
-  obj["hasConstexprNonCopyMoveConstructor"] = decl.hasConstexprNonCopyMoveConstructor();
-  obj["defaultedDefaultConstructorIsConstexpr"] = decl.defaultedDefaultConstructorIsConstexpr();
-  obj["hasConstexprDefaultConstructor"] = decl.hasConstexprDefaultConstructor();
-  obj["hasTrivialCopyConstructor"] = decl.hasTrivialCopyConstructor();
-  obj["hasNonTrivialCopyConstructor"] = decl.hasNonTrivialCopyConstructor();
-  obj["hasTrivialCopyAssignment"] = decl.hasTrivialCopyAssignment();
-  obj["hasNonTrivialCopyAssignment"] = decl.hasNonTrivialCopyAssignment();
-  obj["hasTrivialMoveAssignment"] = decl.hasTrivialMoveAssignment();
-  obj["hasNonTrivialMoveAssignment"] = decl.hasNonTrivialMoveAssignment();
-  obj["hasTrivialDestructor"] = decl.hasTrivialDestructor();
-  obj["hasNonTrivialDestructor"] = decl.hasNonTrivialDestructor();
-  obj["hasIrrelevantDestructor"] = decl.hasIrrelevantDestructor();
-  obj["hasNonLiteralTypeFieldsOrBases"] = decl.hasNonLiteralTypeFieldsOrBases();
-  obj["isTriviallyCopyable"] = decl.isTriviallyCopyable();
-  obj["isTrivial"] = decl.isTrivial();
-  obj["isLiteral"] = decl.isLiteral();
-  obj["mayBeAbstract"] = decl.mayBeAbstract();
-  obj["isDependentLambda"] = decl.isDependentLambda();
-
-  json::Array bases;
-  for (auto itr = decl.bases_begin(); itr != decl.bases_end(); ++itr) {
-    json::Object base;
-    ::visit(base, *itr, ctx);
-    bases.emplace_back(base);
-  };
-  obj["bases"] = bases;
-
-  json::Array vbases;
-  for (auto itr = decl.vbases_begin(); itr != decl.vbases_end(); ++itr) { 
-    json::Object vbase;
-    ::visit(vbase, *itr, ctx);
-    vbases.emplace_back(vbase);
-  }
-  obj["vbases"] = vbases;
-
-  json::Array methods;
-  for (auto itr = decl.method_begin(); itr != decl.method_end(); ++itr) { 
-    json::Object method;
-    ::visit(method, *itr, ctx);
-    methods.emplace_back(method);
-  }
-  obj["methods"] = methods;
-
-  json::Array ctors;
-  for (auto itr = decl.ctor_begin(); itr != decl.ctor_end(); ++itr) {
-    json::Object ctor;
-    ::visit(ctor, *itr, ctx);
-    ctors.emplace_back(ctor);
-  }
-  obj["ctors"] = ctors;
-
-  json::Array friends;
-  for (auto itr = decl.friend_begin(); itr != decl.friend_end(); ++itr) {
-    json::Object friend_;
-    ::visit(friend_, *itr, ctx);
-    friends.emplace_back(friend_);
-  }
-  obj["friends"] = friends;
-
-  }
-
-  ::visit(obj, static_cast<const clang::RecordDecl&>(decl), ctx);
+  const bool hasDefinition = decl.hasDefinition();
+  WRITE_FIELD("hasDefinition", hasDefinition);
+
+  if (hasDefinition) {
+
+  WRITE_TRAITS("cxxRecordTraits", CXX_RECORD_DECL_TRAITS)
+
+  visit_array(out, "bases", decl.bases_begin(), decl.bases_end(), ctx);
+
+  visit_array(out, "vbases", decl.vbases_begin(), decl.vbases_end(), ctx);
+
+  visit_refs(out, "methods", decl.method_begin(), decl.method_end(), ctx);
+
+  visit_refs(out, "ctors", decl.ctor_begin(), decl.ctor_end(), ctx);
+
+  visit_refs(out, "friends", decl.friend_begin(), decl.friend_end(), ctx);
+
+  }
+
+  ::visit(out, static_cast<const clang::RecordDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXBaseSpecifier,
-  obj["isVirtual"] = decl.isVirtual();
-  obj["isBaseOfClass"] = decl.isBaseOfClass();
-  obj["isPackExpansion"] = decl.isPackExpansion();
-  obj["getInheritConstructors"] = decl.getInheritConstructors();
-  obj["type"] = decl.getType().getAsString();
+  out.write("isVirtual", decl.isVirtual());
+  out.write("isBaseOfClass", decl.isBaseOfClass());
+  out.write("isPackExpansion", decl.isPackExpansion());
+  out.write("getInheritConstructors", decl.getInheritConstructors());
+  visit_type(out, "type", decl.getType(), ctx);
 
-  json::Object src;
-  ::visit(src, decl.getSourceRange(), ctx);
-  obj["sourceRange"] = src;
+  visit_range(out, "sourceRange", decl.getSourceRange(), ctx);
 );
 
 VISIT_SPEC(clang::ClassTemplateSpecializationDecl,
-  obj["isExplicitSpecialization"] = decl.isExplicitSpecialization();
+  WRITE_FIELD("isExplicitSpecialization", decl.isExplicitSpecialization());
 
-  ::visit(obj, decl.getTemplateArgs(), ctx);
-  ::visit(obj, static_cast<const clang::CXXRecordDecl&>(decl), ctx);
+  ::visit(out, decl.getTemplateArgs(), ctx);
+  ::visit(out, static_cast<const clang::CXXRecordDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::ClassTemplatePartialSpecializationDecl,
-  obj["isMemberSpecialization"] = const_cast<clang::ClassTemplatePartialSpecializationDecl&>(decl).isMemberSpecialization();
+  WRITE_FIELD("isMemberSpecialization", const_cast<clang::ClassTemplatePartialSpecializationDecl&>(decl).isMemberSpecialization());
 
   const auto params = decl.getTemplateParameters();
   if (params)
-    ::visit(obj, *params, ctx);
+    ::visit(out, *params, ctx);
 
-  ::visit(obj, static_cast<const clang::ClassTemplateSpecializationDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::ClassTemplateSpecializationDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::TemplateTypeParmDecl);
@@ -423,13 +937,13 @@ DEFAULT_VISIT_SPEC(clang::TemplateTypeParmDecl);
 DEFAULT_VISIT_SPEC(clang::TypeAliasDecl);
 
 VISIT_SPEC(clang::TypedefDecl,
-  ::visit(obj, static_cast<const clang::TypedefNameDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::TypedefNameDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::TypedefNameDecl,
-  obj["type"] = decl.getUnderlyingType().getAsString();
+  visit_type(out, "type", decl.getUnderlyingType(), ctx);
 
-  ::visit(obj, static_cast<const clang::TypeDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::TypeDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::UnresolvedUsingTypenameDecl);
@@ -441,25 +955,21 @@ DEFAULT_VISIT_SPEC(clang::UsingDirectiveDecl);
 DEFAULT_VISIT_SPEC(clang::UsingShadowDecl);
 
 VISIT_SPEC(clang::FieldDecl,
-  obj["index"] = json::Number(decl.getFieldIndex());
-  obj["isMutable"] = decl.isMutable();
-  obj["isBitField"] = decl.isBitField();
-  obj["isUnnamedBitfield"] = decl.isUnnamedBitfield();
-  obj["isAnonymousStructOrUnion"] = decl.isAnonymousStructOrUnion();
-  obj["hasInClassInitializer"] = decl.hasInClassInitializer();
+  WRITE_FIELD("index", decl.getFieldIndex());
+  WRITE_TRAITS("fieldTraits", FIELD_DECL_TRAITS)
 
-  ::visit(obj, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::DeclaratorDecl,
-  ::visit(obj, static_cast<const clang::ValueDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::ValueDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::ValueDecl,
-  obj["type"] = decl.getType().getAsString();
-  obj["isWeak"] = decl.isWeak();
+  visit_type(out, "type", decl.getType(), ctx);
+  WRITE_FIELD("isWeak", decl.isWeak());
 
-  ::visit(obj, static_cast<const clang::NamedDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::NamedDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::ObjCAtDefsFieldDecl);
@@ -467,164 +977,93 @@ DEFAULT_VISIT_SPEC(clang::ObjCAtDefsFieldDecl);
 DEFAULT_VISIT_SPEC(clang::ObjCIvarDecl);
 
 VISIT_SPEC(clang::FunctionDecl,
-  obj["isInlineSpecified"] = decl.isInlineSpecified();
-  obj["isOutOfLine"] = decl.isOutOfLine();
+  WRITE_TRAITS("functionTraits", FUNCTION_DECL_TRAITS)
 
   if (decl.hasBody()) {
-    obj["hasBody"] = true;
+    WRITE_FIELD("hasBody", true);
 
     if (decl.isInlined()) {
-      obj["isInlined"] = true;
-      obj["isInlineDefinitionExternallyVisible"] = decl.isInlineDefinitionExternallyVisible();
+      WRITE_FIELD("isInlined", true);
+      WRITE_FIELD("isInlineDefinitionExternallyVisible", decl.isInlineDefinitionExternallyVisible());
     }
     else
-      obj["isInlined"] = false;
+      WRITE_FIELD("isInlined", false);
   }
   else {
-    obj["hasBody"] = false;
-  }
-
-  obj["isOverloadedOperator"] = decl.isOverloadedOperator();
-  obj["isFunctionTemplateSpecialization"] = decl.isFunctionTemplateSpecialization();
-  obj["isTemplateInstantiation"] = decl.isTemplateInstantiation();
-  obj["hasTrivialBody"] = decl.hasTrivialBody();
-  obj["isThisDeclarationADefinition"] = decl.isThisDeclarationADefinition();
-  obj["doesThisDeclarationHaveABody"] = decl.doesThisDeclarationHaveABody();
-  obj["isDefined"] = decl.isDefined();
-  obj["isVariadic"] = decl.isVariadic();
-  obj["isVirtualAsWritten"] = decl.isVirtualAsWritten();
-  obj["isPure"] = decl.isPure();
-  obj["isLateTemplateParsed"] = decl.isLateTemplateParsed();
-  obj["isTrivial"] = decl.isTrivial();
-  obj["isDefaulted"] = decl.isDefaulted();
-  obj["isExplicitlyDefaulted"] = decl.isExplicitlyDefaulted();
-  obj["hasImplicitReturnZero"] = decl.hasImplicitReturnZero();
-  obj["hasPrototype"] = decl.hasPrototype();
-  obj["hasWrittenPrototype"] = decl.hasWrittenPrototype();
-  obj["hasInheritedPrototype"] = decl.hasInheritedPrototype();
-  obj["isConstexpr"] = decl.isConstexpr();
-  obj["isDeleted"] = decl.isDeleted();
-  obj["isMain"] = decl.isMain();
-  obj["isExternC"] = decl.isExternC();
-  obj["isGlobal"] = decl.isGlobal();
-  obj["hasSkippedBody"] = decl.hasSkippedBody();
-  obj["isImplicitlyInstantiable"] = decl.isImplicitlyInstantiable();
-
-  obj["resultType"] = decl.getResultType().getAsString();
-  json::Array params;
-  for (auto itr = decl.param_begin(); itr != decl.param_end(); ++itr) {
-    json::Object param;
-    ::visit(param, *itr, ctx);
-    params.emplace_back(param);
-  }
-  obj["params"] = params;
-
-  ::visit(obj, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
-  ::visit(obj, static_cast<const clang::DeclContext&>(decl), ctx);
+    WRITE_FIELD("hasBody", false);
+  }
+
+  visit_type(out, "resultType", decl.getResultType(), ctx);
+  visit_decls(out, "params", decl.param_begin(), decl.param_end(), ctx);
+
+  ::visit(out, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::DeclContext&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXMethodDecl,
-  obj["isStatic"] = decl.isStatic();
-  obj["isInstance"] = decl.isInstance();
-  obj["isConst"] = decl.isConst();
-  obj["isVolatile"] = decl.isVolatile();
-  obj["isVirtual"] = decl.isVirtual();
-  obj["isUsualDeallocationFunction"] = decl.isUsualDeallocationFunction();
-  obj["isCopyAssignmentOperator"] = decl.isCopyAssignmentOperator();
-  obj["isMoveAssignmentOperator"] = decl.isMoveAssignmentOperator();
-  obj["isUserProvided"] = decl.isUserProvided();
-  obj["hasInlineBody"] = decl.hasInlineBody();
-  obj["isLambdaStaticInvoker"] = decl.isLambdaStaticInvoker();
+  WRITE_TRAITS("methodTraits", CXX_METHOD_DECL_TRAITS)
 
-  ::visit(obj, static_cast<const clang::FunctionDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::FunctionDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXConstructorDecl,
-  obj["isExplicit"] = decl.isExplicit();
+  WRITE_TRAITS("constructorTraits", CXX_CONSTRUCTOR_DECL_TRAITS)
 
   if (decl.isThisDeclarationADefinition()) {
-    obj["isExplicitSpecified"] = decl.isExplicitSpecified();
-    obj["isImplicitlyDefined"] = decl.isImplicitlyDefined();
+    WRITE_FIELD("isExplicitSpecified", decl.isExplicitSpecified());
+    WRITE_FIELD("isImplicitlyDefined", decl.isImplicitlyDefined());
   }
 
-  obj["isDelgatingConstructor"] = decl.isDelegatingConstructor();
-  obj["isDefaultConstructor"] = decl.isDefaultConstructor();
-  obj["isCopyConstructor"] = decl.isCopyConstructor();
-  obj["isMoveConstructor"] = decl.isMoveConstructor();
-  obj["isCopyOrMoveConstructor"] = decl.isCopyOrMoveConstructor();
-  obj["isConvertingConstructor"] = decl.isConvertingConstructor(false);
-  obj["isExplicitConvertingConstructor"] = decl.isConvertingConstructor(true);
-  obj["isSpecializationCopyingObject"] = decl.isSpecializationCopyingObject();
-
-  ::visit(obj, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXConversionDecl, 
-  obj["isExplicitSpecified"] = decl.isExplicitSpecified();
-  obj["isExplicit"] = decl.isExplicit();
-  obj["conversionType"] = decl.getConversionType().getAsString();
-  obj["isLambdaToBlockPointerConversion"] = decl.isLambdaToBlockPointerConversion();
+  WRITE_FIELD("isExplicitSpecified", decl.isExplicitSpecified());
+  WRITE_FIELD("isExplicit", decl.isExplicit());
+  visit_type(out, "conversionType", decl.getConversionType(), ctx);
+  WRITE_FIELD("isLambdaToBlockPointerConversion", decl.isLambdaToBlockPointerConversion());
 
-  ::visit(obj, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::CXXDestructorDecl,
   if (decl.isThisDeclarationADefinition())
-    obj["isImplicitlyDefined"] = decl.isImplicitlyDefined();
+    WRITE_FIELD("isImplicitlyDefined", decl.isImplicitlyDefined());
 
-  ::visit(obj, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::CXXMethodDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::NonTypeTemplateParmDecl);
 
 VISIT_SPEC(clang::VarDecl, 
-  //obj["isThreadSpecified"] = decl.isThreadSpecified();
-  obj["hasLocalStorage"] = decl.hasLocalStorage();
-  obj["isStaticLocal"] = decl.isStaticLocal();
-  obj["hasExternalStorage"] = decl.hasExternalStorage();
-  obj["hasGlobalStorage"] = decl.hasGlobalStorage();
-  obj["isExternC"] = decl.isExternC();
-  obj["isLocalVarDecl"] = decl.isLocalVarDecl();
-  obj["isFunctionOrMethodVarDecl"] = decl.isFunctionOrMethodVarDecl();
-  obj["isStaticDataMember"] = decl.isStaticDataMember();
-  obj["isOutOfLine"] = decl.isOutOfLine();
-  obj["isFileVarDecl"] = decl.isFileVarDecl();
-  obj["hasInit"] = decl.hasInit();
-  //obj["extendsLifetimeOfTemporary"] = decl.extendsLifetimeOfTemporary();
-  obj["isUsableInConstantExpressions"] = decl.isUsableInConstantExpressions(const_cast<clang::ASTContext&>(ctx));
-  //obj["isInitKnownICE"] = decl.isInitKnownICE();
-  //obj["isInitICE"] = decl.isInitICE();
-  //obj["checkInitIsICE"] = decl.checkInitIsICE();
-  obj["isDirectInit"] = decl.isDirectInit();
-  obj["isExceptionVariable"] = decl.isExceptionVariable();
-  obj["isNRVOVariable"] = decl.isNRVOVariable();
-  obj["isCXXForRangeDecl"] = decl.isCXXForRangeDecl();
-  obj["isConstexpr"] = decl.isConstexpr();
-
-  ::visit(obj, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
+  //out.write("isThreadSpecified", decl.isThreadSpecified());
+  //out.write("extendsLifetimeOfTemporary", decl.extendsLifetimeOfTemporary());
+  //out.write("isInitKnownICE", decl.isInitKnownICE());
+  //out.write("isInitICE", decl.isInitICE());
+  //out.write("checkInitIsICE", decl.checkInitIsICE());
+  WRITE_TRAITS("varTraits", VAR_DECL_TRAITS)
+
+  ::visit(out, static_cast<const clang::DeclaratorDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::ImplicitParamDecl);
 
 VISIT_SPEC(clang::ParmVarDecl,
-  obj["functionScopeDepth"] = json::Number(decl.getFunctionScopeDepth());
-  obj["functionScopeIndex"] = json::Number(decl.getFunctionScopeIndex());
-  obj["isKNRPromoted"] = decl.isKNRPromoted();
-  obj["hasDefaultArg"] = decl.hasDefaultArg();
-  obj["hasUnparsedDefaultArg"] = decl.hasUnparsedDefaultArg();
-  obj["hasUninstantiatedDefaultArg"] = decl.hasUninstantiatedDefaultArg();
-  obj["hasInheritedDefaultArg"] = decl.hasInheritedDefaultArg();
-  obj["isParameterPack"] = decl.isParameterPack();
+  WRITE_FIELD("functionScopeDepth", decl.getFunctionScopeDepth());
+  WRITE_FIELD("functionScopeIndex", decl.getFunctionScopeIndex());
+  WRITE_TRAITS("parmTraits", PARM_VAR_DECL_TRAITS)
 
-  ::visit(obj, static_cast<const clang::VarDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::VarDecl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::EnumConstantDecl,
-  // radix 10
-  const auto& initVal = decl.getInitVal().toString(10);
-  obj["value"] = json::Number(std::atoi(initVal.c_str()));
+  if (wants(ctx, "value")) {
+    // radix 10
+    const auto& initVal = decl.getInitVal().toString(10);
+    out.write("value", std::atoi(initVal.c_str()));
+  }
 
-  ::visit(obj, static_cast<const clang::ValueDecl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::ValueDecl&>(decl), ctx);
 );
 
 DEFAULT_VISIT_SPEC(clang::IndirectFieldDecl);
@@ -638,105 +1077,72 @@ DEFAULT_VISIT_SPEC(clang::StaticAssertDecl);
 DEFAULT_VISIT_SPEC(clang::TranslationUnitDecl);
 
 VISIT_SPEC(clang::MacroDirective,
-  ::visit(obj, *decl.getMacroInfo(), ctx);
+  ::visit(out, *decl.getMacroInfo(), ctx);
 );
 
 VISIT_SPEC(clang::MacroInfo,
-  obj["node_type"] = "Macro";
+  out.write("node_type", "Macro");
 
   std::stringstream cat;
   for (auto itr = decl.tokens_begin(); itr != decl.tokens_end(); ++itr)
-    cat << ctx.getSpelling(*itr);
-  obj["definition"] = escape_string(cat.str());
-
-  json::Object begin;
-  ::visit(begin, decl.getDefinitionLoc(), ctx);
-  obj["begin"] = begin;
+    cat << ctx.source.getSpelling(*itr);
+  out.write("definition", cat.str());
 
-  json::Object end;
-  ::visit(end, decl.getDefinitionEndLoc(), ctx);
-  obj["end"] = end;
+  visit_location(out, "begin", decl.getDefinitionLoc(), ctx);
+  visit_location(out, "end", decl.getDefinitionEndLoc(), ctx);
 
   if (decl.getNumTokens() > 0) {
     if (decl.isObjectLike())
-      obj["kind"] = clang::tok::getTokenName(decl.getReplacementToken(0).getKind());
+      out.write("kind", clang::tok::getTokenName(decl.getReplacementToken(0).getKind()));
     else if (decl.isFunctionLike())
-      obj["kind"] = "mixin";
+      out.write("kind", "mixin");
   }
 );
 
 VISIT_SPEC(clang::Token,
-  obj["name"] = ctx.getSpelling(decl);
+  out.write("name", ctx.source.getSpelling(decl));
 );
 
 VISIT_SPEC(clang::SourceRange,
-  json::Object begin;
-  ::visit(begin, decl.getBegin(), ctx);
-  obj["begin"] = begin;
-
-  json::Object end;
-  ::visit(end, decl.getEnd(), ctx);
-  obj["end"] = end;
+  visit_object(out, "begin", decl.getBegin(), ctx);
+  visit_object(out, "end", decl.getEnd(), ctx);
 );
 
 VISIT_SPEC(clang::SourceLocation,
   const auto& sm = ctx.getSourceManager();
-  clang::FullSourceLoc loc(decl, sm);
-  if (loc.isValid()) {
-    obj["line"] = json::Number(loc.getSpellingLineNumber());
-    obj["column"] = json::Number(loc.getSpellingColumnNumber());
-
-    const auto fileEntry = sm.getFileEntryForID(loc.getFileID());
-    if (fileEntry != nullptr) {
-      obj["file"] = fileEntry->getName();
-      const auto dirEntry = fileEntry->getDir();
-      if (dirEntry != nullptr)
-        obj["dir"] = dirEntry->getName();
+  const auto loc = ctx.state.locations.resolve(sm, decl);
+  if (loc.valid) {
+    out.write("line", loc.line);
+    out.write("column", loc.column);
+
+    const auto& file = ctx.state.locations.file(sm, loc.file);
+    if (!file.name.empty()) {
+      out.write("file", file.name);
+      if (!file.dir.empty())
+        out.write("dir", file.dir);
     }
   }
 );
 
 VISIT_SPEC(clang::NamedDecl,
-  obj["name"] = decl.getNameAsString();
-  obj["qualifiedName"] = decl.getQualifiedNameAsString();
-  obj["hasLinkage"] = decl.hasLinkage();
-  obj["isHidden"] = decl.isHidden();
-  obj["isCXXClassMember"] = decl.isCXXClassMember();
-  obj["isCXXInstanceMember"] = decl.isCXXInstanceMember();
+  WRITE_FIELD("name", decl.getNameAsString());
+  WRITE_FIELD("qualifiedName", decl.getQualifiedNameAsString());
+  WRITE_TRAITS("namedTraits", NAMED_DECL_TRAITS)
 
-  ::visit(obj, static_cast<const clang::Decl&>(decl), ctx);
+  ::visit(out, static_cast<const clang::Decl&>(decl), ctx);
 );
 
 VISIT_SPEC(clang::DeclContext,
-  obj["node_type"] = decl.getDeclKindName();
-  obj["isClosure"] = decl.isClosure();
-  obj["isFunctionOrMethod"] = decl.isFunctionOrMethod();
-  obj["isFileContext"] = decl.isFileContext();
-  obj["isTranslationUnit"] = decl.isTranslationUnit();
-  obj["isRecord"] = decl.isRecord();
-  obj["isNamespace"] = decl.isNamespace();
-  obj["isInlineNamespace"] = decl.isInlineNamespace();
-  obj["isDependentContext"] = decl.isDependentContext();
-  obj["isTransparentContext"] = decl.isTransparentContext();
-  //obj["isExternCContext"] = decl.isExternCContext();
-  obj["hasExternalLexicalStorage"] = decl.hasExternalLexicalStorage();
-  obj["hasExternalVisibleStorage"] = decl.hasExternalVisibleStorage();
-
-  json::Array declarations;
-  for (auto itr = decl.decls_begin(); itr != decl.decls_end(); ++itr) {
-    json::Object declaration;
-    dispatch_decl(declaration, **itr, ctx);
-    declarations.emplace_back(declaration);
-  }
-  obj["context"] = declarations;
+  //out.write("isExternCContext", decl.isExternCContext());
+  WRITE_TRAITS("contextTraits", DECL_CONTEXT_TRAITS)
+
+  visit_context(out, decl, ctx);
 );
 
 VISIT_SPEC(clang::Decl,
-  json::Object src;
-  ::visit(src, decl.getSourceRange(), ctx);
-  obj["sourceRange"] = src;
+  visit_range(out, "sourceRange", decl.getSourceRange(), ctx);
 
-  obj["node_type"] = decl.getDeclKindName();  
+  out.write("node_type", decl.getDeclKindName());  
 )
 
 /*
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "writer.hpp"
+
+#include <cstddef>
+#include <ostream>
+
+// Counts what JsonStreamWriter would emit without producing any of it.  On
+// flush() the totals are written to the stream as a single JSON object, which
+// makes it cheap to measure how large a dump would be, or how much a change to
+// the field list costs, on a whole project.
+class SizeEstimator : public WriterBase<SizeEstimator> {
+public:
+  explicit SizeEstimator(std::ostream& stream)
+    : _stream(stream), _bytes(0), _objects(0), _arrays(0), _keys(0), _values(0), _separate(false) { }
+
+  void begin_object() {
+    separate();
+    ++_bytes;
+    ++_objects;
+    _separate = false;
+  }
+
+  void end_object() {
+    ++_bytes;
+    _separate = true;
+  }
+
+  void begin_array() {
+    separate();
+    ++_bytes;
+    ++_arrays;
+    _separate = false;
+  }
+
+  void end_array() {
+    ++_bytes;
+    _separate = true;
+  }
+
+  void key(llvm::StringRef key) {
+    separate();
+    _bytes += string_size(key) + 1;
+    ++_keys;
+    _separate = false;
+  }
+
+  void value(bool value) {
+    separate();
+    _bytes += value ? 4 : 5;
+    ++_values;
+    _separate = true;
+  }
+
+  void value(int64_t value) {
+    separate();
+    _bytes += number_size(value);
+    ++_values;
+    _separate = true;
+  }
+
+  void value(llvm::StringRef value) {
+    separate();
+    _bytes += string_size(value);
+    ++_values;
+    _separate = true;
+  }
+
+  void flush() {
+    _stream << "{\"bytes\":" << _bytes
+            << ",\"objects\":" << _objects
+            << ",\"arrays\":" << _arrays
+            << ",\"keys\":" << _keys
+            << ",\"values\":" << _values << "}";
+    _stream.flush();
+  }
+
+private:
+  void separate() {
+    if (_separate)
+      ++_bytes;
+  }
+
+  static std::size_t string_size(llvm::StringRef value) {
+    std::size_t size = value.size() + 2;
+    for (auto c : value) {
+      if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t')
+        size += 1;
+      else if (static_cast<unsigned char>(c) < 0x20)
+        size += 5;
+    }
+    return size;
+  }
+
+  static std::size_t number_size(int64_t value) {
+    std::size_t size = value < 0 ? 2 : 1;
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+    while (magnitude >= 10) {
+      magnitude /= 10;
+      ++size;
+    }
+    return size;
+  }
+
+  std::ostream& _stream;
+  std::size_t _bytes;
+  std::size_t _objects;
+  std::size_t _arrays;
+  std::size_t _keys;
+  std::size_t _values;
+  bool _separate;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Assigns each distinct string a dense id in order of first appearance.  The
+// strings themselves live in the map; ids index strings().
+class StringTable {
+public:
+  uint32_t intern(llvm::StringRef value) {
+    auto result = _ids.insert(std::make_pair(value, static_cast<uint32_t>(_strings.size())));
+    if (result.second)
+      _strings.push_back(result.first->getKey());
+    return result.first->getValue();
+  }
+
+  const std::vector<llvm::StringRef>& strings() const {
+    return _strings;
+  }
+
+private:
+  llvm::StringMap<uint32_t> _ids;
+  std::vector<llvm::StringRef> _strings;
+};
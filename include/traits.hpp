@@ -0,0 +1,276 @@
+#pragma once
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+// Boolean traits written by the visitors, one list per visitor level.  Each
+// entry is TRAIT(key, expression); the expression is evaluated inside the
+// VISIT_SPEC, so decl and ctx are in scope.
+//
+// With SerializationOptions::packTraits the traits of a level are written as
+// bitmasks instead of one key each.  Trait n of a level is bit n % 32 of the
+// mask stored under the level key (see TRAIT_LEVELS) for n < 32, under the
+// level key with a "1" appended for n < 64, and so on.  Masks hold 32 bits so
+// that they survive JSON readers that parse numbers as doubles and can be
+// tested with JavaScript's bitwise operators.
+//
+// Bit positions are the enumerators of the *Trait enums below, and the dump's
+// "traits" table maps every level key to its trait names in bit order.  Only
+// append to a list: reordering it changes the bit positions.
+
+#define NAMED_DECL_TRAITS(TRAIT)                         \
+  TRAIT(hasLinkage, decl.hasLinkage())                   \
+  TRAIT(isHidden, decl.isHidden())                       \
+  TRAIT(isCXXClassMember, decl.isCXXClassMember())       \
+  TRAIT(isCXXInstanceMember, decl.isCXXInstanceMember())
+
+#define DECL_CONTEXT_TRAITS(TRAIT)                                   \
+  TRAIT(isClosure, decl.isClosure())                                 \
+  TRAIT(isFunctionOrMethod, decl.isFunctionOrMethod())               \
+  TRAIT(isFileContext, decl.isFileContext())                         \
+  TRAIT(isTranslationUnit, decl.isTranslationUnit())                 \
+  TRAIT(isRecord, decl.isRecord())                                   \
+  TRAIT(isNamespace, decl.isNamespace())                             \
+  TRAIT(isInlineNamespace, decl.isInlineNamespace())                 \
+  TRAIT(isDependentContext, decl.isDependentContext())               \
+  TRAIT(isTransparentContext, decl.isTransparentContext())           \
+  TRAIT(hasExternalLexicalStorage, decl.hasExternalLexicalStorage()) \
+  TRAIT(hasExternalVisibleStorage, decl.hasExternalVisibleStorage())
+
+#define TAG_DECL_TRAITS(TRAIT)                                             \
+  TRAIT(isThisDeclarationADefinition, decl.isThisDeclarationADefinition()) \
+  TRAIT(isCompleteDefinition, decl.isCompleteDefinition())                 \
+  TRAIT(isBeingDefined, decl.isBeingDefined())                             \
+  TRAIT(isEmbeddedInDeclarator, decl.isEmbeddedInDeclarator())             \
+  TRAIT(isFreeStanding, decl.isFreeStanding())                             \
+  TRAIT(isDependentType, decl.isDependentType())                           \
+  TRAIT(isStruct, decl.isStruct())                                         \
+  TRAIT(isInterface, decl.isInterface())                                   \
+  TRAIT(isClass, decl.isClass())                                           \
+  TRAIT(isUnion, decl.isUnion())                                           \
+  TRAIT(isEnum, decl.isEnum())
+
+#define RECORD_DECL_TRAITS(TRAIT)                                  \
+  TRAIT(hasFlexibleArrayMember, decl.hasFlexibleArrayMember())     \
+  TRAIT(isAnonymousStructOrUnion, decl.isAnonymousStructOrUnion()) \
+  TRAIT(hasObjectMember, decl.hasObjectMember())                   \
+  TRAIT(isInjectedClassName, decl.isInjectedClassName())
+
+#define CXX_RECORD_DECL_TRAITS(TRAIT)                                                                \
+  TRAIT(isDynamicClass, decl.isDynamicClass())                                                       \
+  TRAIT(hasAnyDependentBases, decl.hasAnyDependentBases())                                           \
+  TRAIT(hasFriends, decl.hasFriends())                                                               \
+  TRAIT(hasSimpleMoveConstructor, decl.hasSimpleMoveConstructor())                                   \
+  TRAIT(hasSimpleMoveAssignment, decl.hasSimpleMoveAssignment())                                     \
+  TRAIT(hasSimpleDestructor, decl.hasSimpleDestructor())                                             \
+  TRAIT(hasDefaultConstructor, decl.hasDefaultConstructor())                                         \
+  TRAIT(needsImplicitDefaultConstructor, decl.needsImplicitDefaultConstructor())                     \
+  TRAIT(hasUserDeclaredConstructor, decl.hasUserDeclaredConstructor())                               \
+  TRAIT(hasUserProvidedDefaultConstructor, decl.hasUserProvidedDefaultConstructor())                 \
+  TRAIT(hasUserDeclaredCopyConstructor, decl.hasUserDeclaredCopyConstructor())                       \
+  TRAIT(needsImplicitCopyConstructor, decl.needsImplicitCopyConstructor())                           \
+  TRAIT(needsOverloadResolutionForCopyConstructor, decl.needsOverloadResolutionForCopyConstructor()) \
+  TRAIT(implicitCopyConstructorHasConstParam, decl.implicitCopyConstructorHasConstParam())           \
+  TRAIT(hasCopyConstructorWithConstParam, decl.hasCopyConstructorWithConstParam())                   \
+  TRAIT(hasUserDeclaredMoveOperation, decl.hasUserDeclaredMoveOperation())                           \
+  TRAIT(hasUserDeclaredMoveConstructor, decl.hasUserDeclaredMoveConstructor())                       \
+  TRAIT(hasMoveConstructor, decl.hasMoveConstructor())                                               \
+  TRAIT(hasFailedImplicitMoveConstructor, decl.hasFailedImplicitMoveConstructor())                   \
+  TRAIT(needsImplicitMoveConstructor, decl.needsImplicitMoveConstructor())                           \
+  TRAIT(needsOverloadResolutionForMoveConstructor, decl.needsOverloadResolutionForMoveConstructor()) \
+  TRAIT(hasUserDeclaredCopyAssignment, decl.hasUserDeclaredCopyAssignment())                         \
+  TRAIT(needsImplicitCopyAssignment, decl.needsImplicitCopyAssignment())                             \
+  TRAIT(needsOverloadResolutionForCopyAssignment, decl.needsOverloadResolutionForCopyAssignment())   \
+  TRAIT(implicitCopyAssignmentHasConstParam, decl.implicitCopyAssignmentHasConstParam())             \
+  TRAIT(hasCopyAssignmentWithConstParam, decl.hasCopyAssignmentWithConstParam())                     \
+  TRAIT(hasUserDeclaredMoveAssignment, decl.hasUserDeclaredMoveAssignment())                         \
+  TRAIT(hasMoveAssignmeTnt, decl.hasMoveAssignment())                                                \
+  TRAIT(hasFailedImplicitMoveAssignment, decl.hasFailedImplicitMoveAssignment())                     \
+  TRAIT(needsImplicitMoveAssignment, decl.needsImplicitMoveAssignment())                             \
+  TRAIT(needsOverloadResolutionForMoveAssignment, decl.needsOverloadResolutionForMoveAssignment())   \
+  TRAIT(hasUserDeclaredDestructor, decl.hasUserDeclaredDestructor())                                 \
+  TRAIT(needsImplicitDestructor, decl.needsImplicitDestructor())                                     \
+  TRAIT(needsOverloadResolutionForDestructor, decl.needsOverloadResolutionForDestructor())           \
+  TRAIT(isLambda, decl.isLambda())                                                                   \
+  TRAIT(isAggregate, decl.isAggregate())                                                             \
+  TRAIT(hasInClassInitializer, decl.hasInClassInitializer())                                         \
+  TRAIT(hasUninitializedReferenceMember, decl.hasUninitializedReferenceMember())                     \
+  TRAIT(isPOD, decl.isPOD())                                                                         \
+  TRAIT(isCLike, decl.isCLike())                                                                     \
+  TRAIT(isEmpty, decl.isEmpty())                                                                     \
+  TRAIT(isPolymorphic, decl.isPolymorphic())                                                         \
+  TRAIT(isAbstract, decl.isAbstract())                                                               \
+  TRAIT(isStandardLayout, decl.isStandardLayout())                                                   \
+  TRAIT(hasMutableFields, decl.hasMutableFields())                                                   \
+  TRAIT(hasTrivialDefaultConstructor, decl.hasTrivialDefaultConstructor())                           \
+  TRAIT(hasNonTrivialDefaultConstructor, decl.hasNonTrivialDefaultConstructor())                     \
+  TRAIT(hasConstexprNonCopyMoveConstructor, decl.hasConstexprNonCopyMoveConstructor())               \
+  TRAIT(defaultedDefaultConstructorIsConstexpr, decl.defaultedDefaultConstructorIsConstexpr())       \
+  TRAIT(hasConstexprDefaultConstructor, decl.hasConstexprDefaultConstructor())                       \
+  TRAIT(hasTrivialCopyConstructor, decl.hasTrivialCopyConstructor())                                 \
+  TRAIT(hasNonTrivialCopyConstructor, decl.hasNonTrivialCopyConstructor())                           \
+  TRAIT(hasTrivialCopyAssignment, decl.hasTrivialCopyAssignment())                                   \
+  TRAIT(hasNonTrivialCopyAssignment, decl.hasNonTrivialCopyAssignment())                             \
+  TRAIT(hasTrivialMoveAssignment, decl.hasTrivialMoveAssignment())                                   \
+  TRAIT(hasNonTrivialMoveAssignment, decl.hasNonTrivialMoveAssignment())                             \
+  TRAIT(hasTrivialDestructor, decl.hasTrivialDestructor())                                           \
+  TRAIT(hasNonTrivialDestructor, decl.hasNonTrivialDestructor())                                     \
+  TRAIT(hasIrrelevantDestructor, decl.hasIrrelevantDestructor())                                     \
+  TRAIT(hasNonLiteralTypeFieldsOrBases, decl.hasNonLiteralTypeFieldsOrBases())                       \
+  TRAIT(isTriviallyCopyable, decl.isTriviallyCopyable())                                             \
+  TRAIT(isTrivial, decl.isTrivial())                                                                 \
+  TRAIT(isLiteral, decl.isLiteral())                                                                 \
+  TRAIT(mayBeAbstract, decl.mayBeAbstract())                                                         \
+  TRAIT(isDependentLambda, decl.isDependentLambda())
+
+#define FIELD_DECL_TRAITS(TRAIT)                                   \
+  TRAIT(isMutable, decl.isMutable())                               \
+  TRAIT(isBitField, decl.isBitField())                             \
+  TRAIT(isUnnamedBitfield, decl.isUnnamedBitfield())               \
+  TRAIT(isAnonymousStructOrUnion, decl.isAnonymousStructOrUnion()) \
+  TRAIT(hasInClassInitializer, decl.hasInClassInitializer())
+
+#define FUNCTION_DECL_TRAITS(TRAIT)                                                \
+  TRAIT(isInlineSpecified, decl.isInlineSpecified())                               \
+  TRAIT(isOutOfLine, decl.isOutOfLine())                                           \
+  TRAIT(isOverloadedOperator, decl.isOverloadedOperator())                         \
+  TRAIT(isFunctionTemplateSpecialization, decl.isFunctionTemplateSpecialization()) \
+  TRAIT(isTemplateInstantiation, decl.isTemplateInstantiation())                   \
+  TRAIT(hasTrivialBody, decl.hasTrivialBody())                                     \
+  TRAIT(isThisDeclarationADefinition, decl.isThisDeclarationADefinition())         \
+  TRAIT(doesThisDeclarationHaveABody, decl.doesThisDeclarationHaveABody())         \
+  TRAIT(isDefined, decl.isDefined())                                               \
+  TRAIT(isVariadic, decl.isVariadic())                                             \
+  TRAIT(isVirtualAsWritten, decl.isVirtualAsWritten())                             \
+  TRAIT(isPure, decl.isPure())                                                     \
+  TRAIT(isLateTemplateParsed, decl.isLateTemplateParsed())                         \
+  TRAIT(isTrivial, decl.isTrivial())                                               \
+  TRAIT(isDefaulted, decl.isDefaulted())                                           \
+  TRAIT(isExplicitlyDefaulted, decl.isExplicitlyDefaulted())                       \
+  TRAIT(hasImplicitReturnZero, decl.hasImplicitReturnZero())                       \
+  TRAIT(hasPrototype, decl.hasPrototype())                                         \
+  TRAIT(hasWrittenPrototype, decl.hasWrittenPrototype())                           \
+  TRAIT(hasInheritedPrototype, decl.hasInheritedPrototype())                       \
+  TRAIT(isConstexpr, decl.isConstexpr())                                           \
+  TRAIT(isDeleted, decl.isDeleted())                                               \
+  TRAIT(isMain, decl.isMain())                                                     \
+  TRAIT(isExternC, decl.isExternC())                                               \
+  TRAIT(isGlobal, decl.isGlobal())                                                 \
+  TRAIT(hasSkippedBody, decl.hasSkippedBody())                                     \
+  TRAIT(isImplicitlyInstantiable, decl.isImplicitlyInstantiable())
+
+#define CXX_METHOD_DECL_TRAITS(TRAIT)                                    \
+  TRAIT(isStatic, decl.isStatic())                                       \
+  TRAIT(isInstance, decl.isInstance())                                   \
+  TRAIT(isConst, decl.isConst())                                         \
+  TRAIT(isVolatile, decl.isVolatile())                                   \
+  TRAIT(isVirtual, decl.isVirtual())                                     \
+  TRAIT(isUsualDeallocationFunction, decl.isUsualDeallocationFunction()) \
+  TRAIT(isCopyAssignmentOperator, decl.isCopyAssignmentOperator())       \
+  TRAIT(isMoveAssignmentOperator, decl.isMoveAssignmentOperator())       \
+  TRAIT(isUserProvided, decl.isUserProvided())                           \
+  TRAIT(hasInlineBody, decl.hasInlineBody())                             \
+  TRAIT(isLambdaStaticInvoker, decl.isLambdaStaticInvoker())
+
+#define CXX_CONSTRUCTOR_DECL_TRAITS(TRAIT)                                   \
+  TRAIT(isExplicit, decl.isExplicit())                                       \
+  TRAIT(isDelgatingConstructor, decl.isDelegatingConstructor())              \
+  TRAIT(isDefaultConstructor, decl.isDefaultConstructor())                   \
+  TRAIT(isCopyConstructor, decl.isCopyConstructor())                         \
+  TRAIT(isMoveConstructor, decl.isMoveConstructor())                         \
+  TRAIT(isCopyOrMoveConstructor, decl.isCopyOrMoveConstructor())             \
+  TRAIT(isConvertingConstructor, decl.isConvertingConstructor(false))        \
+  TRAIT(isExplicitConvertingConstructor, decl.isConvertingConstructor(true)) \
+  TRAIT(isSpecializationCopyingObject, decl.isSpecializationCopyingObject())
+
+#define VAR_DECL_TRAITS(TRAIT)                                                                                         \
+  TRAIT(hasLocalStorage, decl.hasLocalStorage())                                                                       \
+  TRAIT(isStaticLocal, decl.isStaticLocal())                                                                           \
+  TRAIT(hasExternalStorage, decl.hasExternalStorage())                                                                 \
+  TRAIT(hasGlobalStorage, decl.hasGlobalStorage())                                                                     \
+  TRAIT(isExternC, decl.isExternC())                                                                                   \
+  TRAIT(isLocalVarDecl, decl.isLocalVarDecl())                                                                         \
+  TRAIT(isFunctionOrMethodVarDecl, decl.isFunctionOrMethodVarDecl())                                                   \
+  TRAIT(isStaticDataMember, decl.isStaticDataMember())                                                                 \
+  TRAIT(isOutOfLine, decl.isOutOfLine())                                                                               \
+  TRAIT(isFileVarDecl, decl.isFileVarDecl())                                                                           \
+  TRAIT(hasInit, decl.hasInit())                                                                                       \
+  TRAIT(isUsableInConstantExpressions, decl.isUsableInConstantExpressions(const_cast<clang::ASTContext&>(ctx.source))) \
+  TRAIT(isDirectInit, decl.isDirectInit())                                                                             \
+  TRAIT(isExceptionVariable, decl.isExceptionVariable())                                                               \
+  TRAIT(isNRVOVariable, decl.isNRVOVariable())                                                                         \
+  TRAIT(isCXXForRangeDecl, decl.isCXXForRangeDecl())                                                                   \
+  TRAIT(isConstexpr, decl.isConstexpr())
+
+#define PARM_VAR_DECL_TRAITS(TRAIT)                                      \
+  TRAIT(isKNRPromoted, decl.isKNRPromoted())                             \
+  TRAIT(hasDefaultArg, decl.hasDefaultArg())                             \
+  TRAIT(hasUnparsedDefaultArg, decl.hasUnparsedDefaultArg())             \
+  TRAIT(hasUninstantiatedDefaultArg, decl.hasUninstantiatedDefaultArg()) \
+  TRAIT(hasInheritedDefaultArg, decl.hasInheritedDefaultArg())           \
+  TRAIT(isParameterPack, decl.isParameterPack())
+
+#define TRAIT_ENUMERATOR(key, ...) key,
+
+enum class NamedTrait : unsigned { NAMED_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class DeclContextTrait : unsigned { DECL_CONTEXT_TRAITS(TRAIT_ENUMERATOR) };
+enum class TagTrait : unsigned { TAG_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class RecordTrait : unsigned { RECORD_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class CXXRecordTrait : unsigned { CXX_RECORD_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class FieldTrait : unsigned { FIELD_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class FunctionTrait : unsigned { FUNCTION_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class CXXMethodTrait : unsigned { CXX_METHOD_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class CXXConstructorTrait : unsigned { CXX_CONSTRUCTOR_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class VarTrait : unsigned { VAR_DECL_TRAITS(TRAIT_ENUMERATOR) };
+enum class ParmVarTrait : unsigned { PARM_VAR_DECL_TRAITS(TRAIT_ENUMERATOR) };
+
+// The packed levels as LEVEL(level key, trait list).
+#define TRAIT_LEVELS(LEVEL)                               \
+  LEVEL("namedTraits", NAMED_DECL_TRAITS)                 \
+  LEVEL("contextTraits", DECL_CONTEXT_TRAITS)             \
+  LEVEL("tagTraits", TAG_DECL_TRAITS)                     \
+  LEVEL("recordTraits", RECORD_DECL_TRAITS)               \
+  LEVEL("cxxRecordTraits", CXX_RECORD_DECL_TRAITS)        \
+  LEVEL("fieldTraits", FIELD_DECL_TRAITS)                 \
+  LEVEL("functionTraits", FUNCTION_DECL_TRAITS)           \
+  LEVEL("methodTraits", CXX_METHOD_DECL_TRAITS)           \
+  LEVEL("constructorTraits", CXX_CONSTRUCTOR_DECL_TRAITS) \
+  LEVEL("varTraits", VAR_DECL_TRAITS)                     \
+  LEVEL("parmTraits", PARM_VAR_DECL_TRAITS)
+
+// Collects the traits of one level and writes them as masks.
+class TraitMask {
+public:
+  static const unsigned MaxTraits = 128;
+
+  TraitMask() : _masks(), _count(0) { }
+
+  void add(bool value) {
+    if (value)
+      _masks[_count / 32] |= uint32_t(1) << (_count % 32);
+    ++_count;
+  }
+
+  template <typename Writer>
+  void write(Writer& out, llvm::StringRef key) const {
+    out.write(key, _masks[0]);
+    for (unsigned word = 1; word * 32 < _count; ++word) {
+      llvm::SmallString<64> name(key);
+      name += static_cast<char>('0' + word);
+      out.write(name.str(), _masks[word]);
+    }
+  }
+
+private:
+  uint32_t _masks[MaxTraits / 32];
+  unsigned _count;
+};
+
+#define TRAIT_COUNT(key, ...) + 1
+#define CHECK_TRAIT_LEVEL(key, LIST) \
+  static_assert(0 LIST(TRAIT_COUNT) <= TraitMask::MaxTraits, "too many traits in " key);
+TRAIT_LEVELS(CHECK_TRAIT_LEVEL)
+#undef CHECK_TRAIT_LEVEL
+#undef TRAIT_COUNT
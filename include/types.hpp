@@ -0,0 +1,33 @@
+#pragma once
+
+#include "clang/AST/Type.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Assigns each distinct QualType a dense id in order of first appearance.
+// Types are uniqued by the ASTContext, so sugared spellings (typedefs,
+// elaborated names) get ids of their own; their entries refer to the
+// canonical type by id.
+class TypeTable {
+public:
+  uint32_t index(clang::QualType type) {
+    auto result = _ids.insert(std::make_pair(type.getAsOpaquePtr(), static_cast<uint32_t>(_types.size())));
+    if (result.second)
+      _types.push_back(type);
+    return result.first->second;
+  }
+
+  // Entries may still be added while the table is being written, so callers
+  // iterate by index rather than holding on to this vector.
+  const std::vector<clang::QualType>& types() const {
+    return _types;
+  }
+
+private:
+  llvm::DenseMap<void*, uint32_t> _ids;
+  std::vector<clang::QualType> _types;
+};
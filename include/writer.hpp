@@ -0,0 +1,118 @@
+#pragma once
+
+#include "tables.hpp"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+
+// Writer policy used as the Writer parameter of JsonVisitor.  A writer is
+// constructed from the std::ostream it emits to and implements
+//
+//   begin_object() / end_object()
+//   begin_array()  / end_array()
+//   key(llvm::StringRef)
+//   value(bool) / value(int64_t) / value(llvm::StringRef)
+//   flush()
+//
+// as plain (non-virtual) members.  It derives from WriterBase to pick up
+// write() and element(), which funnel the assorted integer and string types
+// produced by the visitors into the three scalar overloads.  After
+// intern_strings() every string passed to write() or element() is replaced by
+// its id in the given StringTable; keys and direct value() calls are not.
+//
+// Implementations: JsonDomWriter (dom_writer.hpp), JsonStreamWriter
+// (json_writer.hpp), SizeEstimator (size_writer.hpp), BinaryWriter
+// (binary_writer.hpp) and CborWriter (cbor_writer.hpp).
+template <typename Derived>
+class WriterBase {
+public:
+  WriterBase() : _strings(nullptr) { }
+
+  void intern_strings(StringTable* strings) {
+    _strings = strings;
+  }
+
+  template <typename Type>
+  void write(llvm::StringRef key, const Type& value) {
+    self().key(key);
+    emit(scalar(value));
+  }
+
+  template <typename Type>
+  void element(const Type& value) {
+    emit(scalar(value));
+  }
+
+private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+
+  void emit(bool value) { self().value(value); }
+
+  void emit(int64_t value) { self().value(value); }
+
+  void emit(llvm::StringRef value) {
+    if (_strings != nullptr)
+      self().value(static_cast<int64_t>(_strings->intern(value)));
+    else
+      self().value(value);
+  }
+
+  static bool scalar(bool value) { return value; }
+
+  template <typename Type>
+  static typename std::enable_if<std::is_integral<Type>::value, int64_t>::type scalar(Type value) { return value; }
+
+  static llvm::StringRef scalar(const char* value) { return value; }
+
+  static llvm::StringRef scalar(llvm::StringRef value) { return value; }
+
+  StringTable* _strings;
+};
+
+// Fixed-size buffer in front of a std::ostream for the writers that produce
+// their output byte by byte.
+class OutputBuffer {
+public:
+  explicit OutputBuffer(std::ostream& stream) : _stream(stream), _size(0) { }
+
+  ~OutputBuffer() {
+    flush();
+  }
+
+  void put(char c) {
+    if (_size == sizeof(_buffer))
+      flush();
+    _buffer[_size++] = c;
+  }
+
+  void append(const char* data, std::size_t size) {
+    if (_size + size > sizeof(_buffer)) {
+      flush();
+      if (size > sizeof(_buffer)) {
+        _stream.write(data, size);
+        return;
+      }
+    }
+    std::memcpy(_buffer + _size, data, size);
+    _size += size;
+  }
+
+  void append(llvm::StringRef data) {
+    append(data.data(), data.size());
+  }
+
+  void flush() {
+    _stream.write(_buffer, _size);
+    _size = 0;
+  }
+
+private:
+  std::ostream& _stream;
+  char _buffer[1 << 16];
+  std::size_t _size;
+};
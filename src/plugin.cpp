@@ -1,12 +1,22 @@
 #include "serialization.hpp"
+#include "hash.hpp"
+#include "output_file.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <fstream>
 
+#include <cstdio>
+#include <cstdlib>
 #include <stdexcept>
 #include <functional>
 
@@ -14,58 +24,412 @@ using namespace clang;
 
 namespace {
 
+enum class OutputFormat {
+  Json,
+  JsonStream,
+  SizeEstimate,
+  Binary,
+  Cbor
+};
+
+struct PluginOptions {
+  OutputFormat format = OutputFormat::Json;
+  Codec codec = Codec::None;
+  int level = 0;
+  bool async = false;
+  bool macrosOnly = false;
+  bool skipBodies = false;
+  bool keepInlineBodies = false;
+  std::string output;
+  std::string outputDir;
+  std::string macroSnapshot;
+  SerializationOptions serialization;
+};
+
+PluginOptions Options;
+
+std::string hexHash(uint64_t hash) {
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
+
+std::string snapshotPath(const std::string& hash);
+
+template <typename Writer>
 class JsonASTPrinter : public ASTConsumer {
 public:
-  explicit JsonASTPrinter(ASTContext& context, json::Array& output) : _context(context), _output(output) { }
+  JsonASTPrinter(ASTContext& context, SerializationState& state, Writer& out) : _context(context, state), _out(out) { }
 
+  // With roots, reachability is only known once the whole translation unit
+  // has been parsed, so the top-level decls are held back until then.
   virtual void HandleTranslationUnit(clang::ASTContext& context) {
-    //Context.getTranslationUnitDecl();
+    const auto& roots = _context.state.options.roots;
+    if (roots.empty())
+      return;
+
+    _context.state.reachable.compute(*context.getTranslationUnitDecl(), roots);
+    for (auto decl : _pending)
+      write(*decl);
+    _pending.clear();
+  }
+
+  // Only asked with skip-bodies.  keep-inline-bodies keeps the bodies of
+  // inline functions: isInlined() also covers member functions defined in
+  // their class, which are inline without the keyword.  Sema never skips
+  // constexpr bodies.  The others are skipped and reported through
+  // hasSkippedBody.
+  virtual bool shouldSkipFunctionBody(Decl* decl) {
+    if (!Options.keepInlineBodies)
+      return true;
+
+    auto function = dyn_cast<FunctionDecl>(decl);
+    if (const auto templ = dyn_cast<FunctionTemplateDecl>(decl))
+      function = templ->getTemplatedDecl();
+    return function == nullptr || !function->isInlined();
   }
 
   virtual bool HandleTopLevelDecl(DeclGroupRef g) {
+    const bool deferred = !_context.state.options.roots.empty();
     for (auto& decl : g) {
-      json::Object obj;
-      dispatch_decl(obj, *decl, _context);
-      _output.emplace_back(obj);
+      if (deferred)
+        _pending.push_back(decl);
+      else
+        write(*decl);
     }
 
     return true;
   }
 
 private:
-  ASTContext& _context;
-  json::Array& _output;
+  void write(const Decl& decl) {
+    if (!selected(decl, _context))
+      return;
+
+    _out.begin_object();
+    visit_decl(_out, decl, _context);
+    _out.end_object();
+  }
+
+  SerializationContext<ASTContext> _context;
+  Writer& _out;
+  std::vector<const Decl*> _pending;
 };
 
+template <typename Writer>
 class PreprocessorCallbacks : public PPCallbacks {
 public:
-  PreprocessorCallbacks(Preprocessor& processor, json::Array& output) : _processor(processor), _output(output) { }
+  PreprocessorCallbacks(Preprocessor& processor, SerializationState& state, Writer& out) : _processor(processor, state), _out(out) { }
 
+  // With macro-snapshot, the macros from the predefines buffer (builtin and
+  // command line macros) go to a snapshot file named after a hash of that
+  // buffer instead of into the dump.  Translation units compiled with the
+  // same flags share the snapshot; the first one to get there writes it.
   virtual void MacroDefined(const Token& identifier, const MacroDirective* info) {
-    json::Object obj;
-    visit(obj, identifier, _processor);
-    visit(obj, *info, _processor);
-    _output.emplace_back(obj);
+    if (!Options.macroSnapshot.empty() && isPredefined(identifier.getLocation())) {
+      if (_snapshot.empty()) {
+        _hash = hexHash(stable_hash(_processor.source.getPredefines()));
+        _snapshot = snapshotPath(_hash);
+        _snapshotExists = llvm::sys::fs::exists(_snapshot);
+      }
+      if (!_snapshotExists)
+        _predefined.push_back(std::make_pair(identifier, info));
+      return;
+    }
+
+    writeSnapshot();
+
+    _out.begin_object();
+    visit(_out, identifier, _processor);
+    visit(_out, *info, _processor);
+    _out.end_object();
   }
 
   virtual void FileChanged(SourceLocation loc, FileChangeReason reason, SrcMgr::CharacteristicKind type, FileID id) {
     //std::cout << _processor.getSourceManager().getBufferName(loc) << std::endl;
   }
 
-  virtual void EndOfMainFile() {
-    //std::cout << "Done" << std::endl;
+  // Called by the session before it closes the dump.  EndOfMainFile would
+  // be too late: clang only calls it from EndSourceFile, after
+  // ExecuteAction has already closed the output.
+  void finish() {
+    writeSnapshot();
   }
 
 private:
-  Preprocessor& _processor;
-  json::Array& _output;
+  bool isPredefined(SourceLocation loc) const {
+    const auto& sm = _processor.getSourceManager();
+    return sm.getFileID(sm.getSpellingLoc(loc)) == _processor.source.getPredefinesFileID();
+  }
+
+  // Writes the snapshot if it does not exist yet and puts a reference to it
+  // into the dump: {"node_type": "MacroSnapshot", "hash": ..., "file": ...}.
+  void writeSnapshot() {
+    if (_snapshot.empty() || _snapshotWritten)
+      return;
+    _snapshotWritten = true;
+
+    if (!_predefined.empty() && !writeMacros()) {
+      auto& diagnostics = _processor.source.getDiagnostics();
+      diagnostics.Report(diagnostics.getCustomDiagID(DiagnosticsEngine::Warning, "failed to write macro snapshot '%0'")) << _snapshot;
+    }
+    _predefined.clear();
+
+    _out.begin_object();
+    _out.write("node_type", "MacroSnapshot");
+    _out.write("hash", _hash);
+    _out.write("file", _snapshot);
+    _out.end_object();
+  }
+
+  // The snapshot is a plain array of macros in the dump's format, without
+  // any of the per-dump tables.
+  bool writeMacros() {
+    static const SerializationOptions plain;
+    SerializationState state(plain);
+    SerializationContext<Preprocessor> context(_processor.source, state);
+
+    OutputFile file(_snapshot, Options.codec, Options.level, false);
+    Writer out(file.stream());
+    out.begin_array();
+    for (const auto& macro : _predefined) {
+      out.begin_object();
+      visit(out, macro.first, context);
+      visit(out, *macro.second, context);
+      out.end_object();
+    }
+    out.end_array();
+    out.flush();
+    return file.close();
+  }
+
+  SerializationContext<Preprocessor> _processor;
+  Writer& _out;
+
+  std::string _hash;
+  std::string _snapshot;
+  bool _snapshotExists = false;
+  bool _snapshotWritten = false;
+  std::vector<std::pair<Token, const MacroDirective*>> _predefined;
 };
 
-typedef std::map<std::string, std::function<void()>> CallbackMap;
+// Owns the output file and the writer for one translation unit, and hands out
+// the clang callbacks that feed it.  The writer type is fixed per session, so
+// the visitors are compiled against it directly.
+class OutputSession {
+public:
+  virtual ~OutputSession() { }
+
+  virtual ASTConsumer* createConsumer(ASTContext& context) = 0;
+  virtual PPCallbacks* createCallbacks(Preprocessor& processor) = 0;
+
+  virtual void begin() = 0;
+  virtual bool end() = 0;
+};
+
+template <typename Writer>
+class WriterSession : public OutputSession {
+public:
+  explicit WriterSession(const std::string& path)
+    : _file(path, Options.codec, Options.level, Options.async), _out(_file.stream()), _state(Options.serialization), _callbacks(nullptr) {
+    if (Options.serialization.internStrings)
+      _out.intern_strings(&_state.strings);
+  }
+
+  virtual ASTConsumer* createConsumer(ASTContext& context) {
+    return new JsonASTPrinter<Writer>(context, _state, _out);
+  }
+
+  // The preprocessor owns the callbacks; the session keeps a pointer to
+  // finish them in end(), while the preprocessor is still alive.
+  virtual PPCallbacks* createCallbacks(Preprocessor& processor) {
+    _callbacks = new PreprocessorCallbacks<Writer>(processor, _state, _out);
+    return _callbacks;
+  }
+
+  // With tables the dump becomes {"decls": [...], "files": [...], ...}; the
+  // tables are only complete once everything else has been written.
+  virtual void begin() {
+    if (_state.hasTables()) {
+      _out.begin_object();
+      _out.key("decls");
+    }
+    _out.begin_array();
+  }
+
+  virtual bool end() {
+    if (_callbacks != nullptr)
+      _callbacks->finish();
+    _out.end_array();
+
+    if (_state.hasTables()) {
+      write_tables(_out, _state);
+      _out.end_object();
+    }
+
+    _out.flush();
+    return _file.close();
+  }
+
+private:
+  OutputFile _file;
+  Writer _out;
+  SerializationState _state;
+  PreprocessorCallbacks<Writer>* _callbacks;
+};
+
+OutputSession* createSession(const std::string& path) {
+  switch (Options.format) {
+    case OutputFormat::JsonStream:
+      return new WriterSession<JsonStreamWriter>(path);
+    case OutputFormat::SizeEstimate:
+      return new WriterSession<SizeEstimator>(path);
+    case OutputFormat::Binary:
+      return new WriterSession<BinaryWriter>(path);
+    case OutputFormat::Cbor:
+      return new WriterSession<CborWriter>(path);
+    case OutputFormat::Json:
+      break;
+  }
+  return new WriterSession<JsonDomWriter>(path);
+}
+
+const char* formatExtension() {
+  switch (Options.format) {
+    case OutputFormat::Binary:
+      return ".bin";
+    case OutputFormat::Cbor:
+      return ".cbor";
+    default:
+      return ".json";
+  }
+}
+
+// The file a translation unit is dumped to: the output argument if given,
+// otherwise output.<ext> in the working directory or, with output-dir, a
+// name derived from the input file.  The derived name is the input's file
+// name plus a hash of its absolute path, so that sources with the same name
+// in different directories do not collide when a whole project is built in
+// parallel.
+std::string outputPath(llvm::StringRef inFile) {
+  if (!Options.output.empty())
+    return Options.output;
+
+  const std::string extension = std::string(formatExtension()) + OutputFile::extension(Options.codec);
+  if (Options.outputDir.empty())
+    return "output" + extension;
+
+  llvm::SmallString<256> absolute(inFile);
+  llvm::sys::fs::make_absolute(absolute);
+
+  llvm::SmallString<256> path(Options.outputDir);
+  llvm::sys::path::append(path, llvm::sys::path::filename(inFile) + "." + hexHash(stable_hash(absolute.str())) + extension);
+  return path.str();
+}
+
+// The snapshot of the predefined macros with the given hash.
+std::string snapshotPath(const std::string& hash) {
+  llvm::SmallString<256> path(Options.macroSnapshot);
+  llvm::sys::path::append(path, "predefined." + hash + formatExtension() + OutputFile::extension(Options.codec));
+  return path.str();
+}
+
+// Parses "<codec>[:<level>]" for the compress argument.  A level the codec
+// does not accept is rejected here rather than when the stream is set up.
+bool parseCompression(const std::string& value) {
+  const auto separator = value.find(':');
+  const auto name = value.substr(0, separator);
+
+  if (name == "gzip") {
+    Options.codec = Codec::Gzip;
+    Options.level = 6;
+  }
+  else if (name == "zstd") {
+    Options.codec = Codec::Zstd;
+    Options.level = 3;
+  }
+  else if (name == "none") {
+    Options.codec = Codec::None;
+    return separator == std::string::npos;
+  }
+  else {
+    return false;
+  }
+
+  if (separator != std::string::npos) {
+    const auto level = value.substr(separator + 1);
+    char* end = nullptr;
+    const auto parsed = std::strtol(level.c_str(), &end, 10);
+    if (level.empty() || *end != '\0' || !valid_level(Options.codec, parsed))
+      return false;
+    Options.level = static_cast<int>(parsed);
+  }
+  return true;
+}
+
+// Splits a comma separated argument value, dropping empty items.
+std::vector<std::string> splitList(llvm::StringRef value) {
+  llvm::SmallVector<llvm::StringRef, 8> items;
+  value.split(items, ",", -1, false);
+  return std::vector<std::string>(items.begin(), items.end());
+}
+
+// Actions receive the text after '=' in "name=value" arguments (empty for
+// plain flags) and return false if it is not acceptable.
+typedef std::map<std::string, std::function<bool(const std::string&)>> CallbackMap;
 
 CallbackMap initArgumentActions() {
   CallbackMap ArgumentActions;
-  ArgumentActions["help"] = [](){ std::cout << "[help]" << std::endl; };
+  ArgumentActions["help"] = [](const std::string&){ std::cout << "[help]" << std::endl; return true; };
+  ArgumentActions["stream"] = [](const std::string&){ Options.format = OutputFormat::JsonStream; return true; };
+  ArgumentActions["size"] = [](const std::string&){ Options.format = OutputFormat::SizeEstimate; return true; };
+  ArgumentActions["binary"] = [](const std::string&){ Options.format = OutputFormat::Binary; return true; };
+  ArgumentActions["cbor"] = [](const std::string&){ Options.format = OutputFormat::Cbor; return true; };
+  ArgumentActions["compress"] = parseCompression;
+  ArgumentActions["macros-only"] = [](const std::string&){ Options.macrosOnly = true; return true; };
+  ArgumentActions["skip-bodies"] = [](const std::string&){ Options.skipBodies = true; return true; };
+  ArgumentActions["keep-inline-bodies"] = [](const std::string&){ Options.skipBodies = Options.keepInlineBodies = true; return true; };
+  ArgumentActions["async"] = [](const std::string&){ Options.async = true; return true; };
+  ArgumentActions["intern"] = [](const std::string&){ Options.serialization.internStrings = true; return true; };
+  ArgumentActions["compact-locations"] = [](const std::string&){ Options.serialization.compactLocations = true; return true; };
+  ArgumentActions["pack-traits"] = [](const std::string&){ Options.serialization.packTraits = true; return true; };
+  ArgumentActions["type-table"] = [](const std::string&){ Options.serialization.typeTable = true; return true; };
+  ArgumentActions["lazy-specializations"] = [](const std::string&){ Options.serialization.lazySpecializations = true; return true; };
+  ArgumentActions["specialize"] = [](const std::string& value){
+    const auto names = splitList(value);
+    Options.serialization.lazySpecializations = true;
+    Options.serialization.specialize.insert(names.begin(), names.end());
+    return !names.empty();
+  };
+  ArgumentActions["fields"] = [](const std::string& value){ return Options.serialization.projection.parse(value); };
+  ArgumentActions["profile"] = [](const std::string& value){ return Options.serialization.projection.profile(value); };
+  ArgumentActions["include-path"] = [](const std::string& value){ Options.serialization.filter.includePath(value); return !value.empty(); };
+  ArgumentActions["exclude-path"] = [](const std::string& value){ Options.serialization.filter.excludePath(value); return !value.empty(); };
+  ArgumentActions["skip-system-headers"] = [](const std::string&){ Options.serialization.filter.skipSystemHeaders = true; return true; };
+  ArgumentActions["kinds"] = [](const std::string& value){
+    const auto kinds = splitList(value);
+    Options.serialization.filter.kinds.insert(kinds.begin(), kinds.end());
+    return !kinds.empty();
+  };
+  ArgumentActions["names"] = [](const std::string& value){ return Options.serialization.filter.includeName(value); };
+  ArgumentActions["exclude-names"] = [](const std::string& value){ return Options.serialization.filter.excludeName(value); };
+  ArgumentActions["external-only"] = [](const std::string&){ Options.serialization.filter.externalOnly = true; return true; };
+  ArgumentActions["roots"] = [](const std::string& value){
+    const auto roots = splitList(value);
+    Options.serialization.roots.insert(roots.begin(), roots.end());
+    return !roots.empty();
+  };
+  ArgumentActions["macro-snapshot"] = [](const std::string& value){
+    bool existed = false;
+    Options.macroSnapshot = value;
+    return !value.empty() && !llvm::sys::fs::create_directories(value, existed);
+  };
+  ArgumentActions["output"] = [](const std::string& value){ Options.output = value; return !value.empty(); };
+  ArgumentActions["output-dir"] = [](const std::string& value){
+    bool existed = false;
+    Options.outputDir = value;
+    return !value.empty() && !llvm::sys::fs::create_directories(value, existed);
+  };
   return ArgumentActions;
 }
 
@@ -73,29 +437,55 @@ CallbackMap ArgumentActions = initArgumentActions();
 
 class PrintASTAction : public PluginASTAction {
 protected:
+  // With macros-only clang sets up neither Sema nor an ASTContext and never
+  // asks for a consumer, so the session is created here instead.
+  virtual bool usesPreprocessorOnly() const {
+    return Options.macrosOnly;
+  }
+
+  virtual bool BeginSourceFileAction(CompilerInstance &Compiler, llvm::StringRef InFile) {
+    if (Options.skipBodies)
+      Compiler.getFrontendOpts().SkipFunctionBodies = true;
+
+    _session.reset(createSession(outputPath(InFile)));
+    return true;
+  }
+
   virtual ASTConsumer* CreateASTConsumer(CompilerInstance &Compiler, llvm::StringRef InFile) {
-    static JsonASTPrinter printer(Compiler.getASTContext(), _output);
-    return &printer;
+    return _session->createConsumer(Compiler.getASTContext());
   }
 
   virtual void ExecuteAction() {
     auto& pp = getCompilerInstance().getPreprocessor();
-    static PreprocessorCallbacks cbs(pp, _output);
-    pp.addPPCallbacks(&cbs);
-
-    PluginASTAction::ExecuteAction();
-
-    std::ofstream output("output.json");
-    json::OutStream out(output);
-    format(out, _output);
+    pp.addPPCallbacks(_session->createCallbacks(pp));
 
+    _session->begin();
+    if (Options.macrosOnly) {
+      // Lex the whole file just for the preprocessor callbacks.
+      pp.EnterMainSourceFile();
+      Token token;
+      do {
+        pp.Lex(token);
+      } while (token.isNot(tok::eof));
+    }
+    else {
+      PluginASTAction::ExecuteAction();
+    }
+    if (!_session->end()) {
+      DiagnosticsEngine &D = getCompilerInstance().getDiagnostics();
+      D.Report(D.getCustomDiagID(DiagnosticsEngine::Error, "failed to write cleng output"));
+    }
   }
 
   bool ParseArgs(const CompilerInstance &CI,
                  const std::vector<std::string>& args) {
 
     for (auto& arg : args) {
-      auto action = ArgumentActions.find(arg);
+      const auto separator = arg.find('=');
+      const auto name = arg.substr(0, separator);
+      const auto value = separator == std::string::npos ? std::string() : arg.substr(separator + 1);
+
+      auto action = ArgumentActions.find(name);
       if (action == ArgumentActions.end()) {
         DiagnosticsEngine &D = CI.getDiagnostics();
         unsigned DiagID = D.getCustomDiagID(DiagnosticsEngine::Error, "invalid argument '" + arg + "'");
@@ -108,15 +498,17 @@ protected:
         D.Report(DiagID);
         return false;
       }
-      else {
-        action->second();
+      else if (!action->second(value)) {
+        DiagnosticsEngine &D = CI.getDiagnostics();
+        D.Report(D.getCustomDiagID(DiagnosticsEngine::Error, "invalid value for argument '" + arg + "'"));
+        return false;
       }
     }
 
     return true;
   }
 
-  json::Array _output;
+  std::unique_ptr<OutputSession> _session;
 };
 
 }